@@ -4,30 +4,261 @@
 #include <cmath>
 #include <optional>
 #include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <memory>
+#include <functional>
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <cstdio>
+#include <cstdlib>
+#include <numeric>
+#include <array>
+#include <chrono>
+#include <random>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <cstddef>
+#include <filesystem>
+#include <condition_variable>
+#include <cerrno>
+#include <csignal>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+#define CALCGAME_AVX512_KERNEL 1
+#define CALCGAME_TARGET_AVX512 __attribute__((target("avx512f,avx512dq")))
+#define CALCGAME_UNROLL _Pragma("GCC unroll 16")
+#elif defined(_MSC_VER) && defined(_M_X64)
+#define CALCGAME_AVX512_KERNEL 1
+#define CALCGAME_TARGET_AVX512
+#define CALCGAME_UNROLL
+#endif
+
+#ifdef CALCGAME_AVX512_KERNEL
+#include <immintrin.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 constexpr int DigitsInCalculator = 10;
-static uint64_t MaxCalculatorIntValue = static_cast<uint64_t>(pow(10, 10) - 1);
 constexpr int MaxMoves = 1000;
 constexpr bool ImplementTwoRepeatingDigitsRule = true;
 
-enum class GameOutcome { unknown, finished, overflow, tooManyMoves };
-static std::vector<GameOutcome> AllGameOutcomes { GameOutcome::finished, GameOutcome::overflow, GameOutcome::tooManyMoves };
+// Build with -DCALCGAME_INSTRUMENT=1 to count the step functions' decisions, see StepCounters.
+#ifndef CALCGAME_INSTRUMENT
+#define CALCGAME_INSTRUMENT 0
+#endif
+constexpr bool InstrumentSteps = CALCGAME_INSTRUMENT != 0;
+
+enum class GameOutcome { unknown, finished, overflow, tooManyMoves, cycle };
+constexpr size_t GameOutcomesCount = 5;
+static std::vector<GameOutcome> AllGameOutcomes { GameOutcome::finished, GameOutcome::overflow, GameOutcome::tooManyMoves, GameOutcome::cycle };
+
+constexpr uint64_t PowersOfTen[] = { 1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull, 10000000ull,
+    100000000ull, 1000000000ull, 10000000000ull, 100000000000ull, 1000000000000ull, 10000000000000ull,
+    100000000000000ull, 1000000000000000ull, 10000000000000000ull, 100000000000000000ull,
+    1000000000000000000ull, 10000000000000000000ull };
+
+constexpr uint64_t MaxCalculatorIntValue = PowersOfTen[DigitsInCalculator] - 1;
+
+int DigitsCount(uint64_t value) {
+    int digits = 1;
+    while (digits < 20 && value >= PowersOfTen[digits]) {
+        digits++;
+    }
+    return digits;
+}
+
+// Branch free digit count of a value below 10^Width.
+template <int Width>
+int DigitsCountUpTo(uint64_t value) {
+    int digits = 1;
+    for (int i = 1; i < Width; i++) {
+        digits += value >= PowersOfTen[i];
+    }
+    return digits;
+}
+
+// a * b / divisor with its remainder, for products that do not fit 64 bits. The quotient must fit.
+uint64_t MulDivMod(uint64_t a, uint64_t b, uint64_t divisor, uint64_t* remainder) {
+#ifdef _MSC_VER
+    uint64_t high;
+    uint64_t low = _umul128(a, b, &high);
+    return _udiv128(high, low, divisor, remainder);
+#else
+    unsigned __int128 product = static_cast<unsigned __int128>(a) * b;
+    *remainder = static_cast<uint64_t>(product % divisor);
+    return static_cast<uint64_t>(product / divisor);
+#endif
+}
+
+// The high 64 bits of a * b.
+uint64_t MulHigh(uint64_t a, uint64_t b) {
+#ifdef _MSC_VER
+    return __umulh(a, b);
+#else
+    return static_cast<uint64_t>(static_cast<unsigned __int128>(a) * b >> 64);
+#endif
+}
+
+// A variant of the game's rules. The engine is instantiated per variant, so its widths and caps are constants.
+template <int Width, bool TwoRepeatingDigitsRule, int MoveCap>
+struct GameRules {
+    static_assert(Width >= 4 && Width <= 16, "values and their carries must fit 64 bits");
+    static constexpr int Digits = Width;
+    static constexpr uint64_t MaxIntValue = PowersOfTen[Width] - 1;
+    static constexpr bool RepeatingDigitsRule = TwoRepeatingDigitsRule;
+    static constexpr int MaxMoves = MoveCap;
+};
+
+using DefaultRules = GameRules<DigitsInCalculator, ImplementTwoRepeatingDigitsRule, MaxMoves>;
+
+// The runtime description of a rules variant, VisitRules maps it to its instantiation.
+struct RulesVariant {
+    int digits = DigitsInCalculator;
+    bool twoRepeatingDigitsRule = ImplementTwoRepeatingDigitsRule;
+    int maxMoves = MaxMoves;
+
+    uint64_t GetMaxIntValue() const { return PowersOfTen[digits] - 1; }
+    bool operator==(const RulesVariant& other) const {
+        return digits == other.digits && twoRepeatingDigitsRule == other.twoRepeatingDigitsRule && maxMoves == other.maxMoves;
+    }
+    bool operator!=(const RulesVariant& other) const {
+        return !(*this == other);
+    }
+};
+
+template <int Width, bool TwoRepeatingDigitsRule, typename Visitor>
+bool VisitRulesMoveCap(const RulesVariant& variant, Visitor& visit) {
+    switch (variant.maxMoves) {
+        case 1000: visit(GameRules<Width, TwoRepeatingDigitsRule, 1000>()); return true;
+        case 10000: visit(GameRules<Width, TwoRepeatingDigitsRule, 10000>()); return true;
+        default: return false;
+    }
+}
+
+template <int Width, typename Visitor>
+bool VisitRulesWidth(const RulesVariant& variant, Visitor& visit) {
+    return variant.twoRepeatingDigitsRule ? VisitRulesMoveCap<Width, true>(variant, visit)
+        : VisitRulesMoveCap<Width, false>(variant, visit);
+}
+
+// Calls visit(Rules()) with the GameRules instantiation of variant; false if that variant is not compiled in.
+// Widths 8, 10, 12 and 16 with caps of 1000 or 10000 moves are.
+template <typename Visitor>
+bool VisitRules(const RulesVariant& variant, Visitor&& visit) {
+    switch (variant.digits) {
+        case 8: return VisitRulesWidth<8>(variant, visit);
+        case 10: return VisitRulesWidth<10>(variant, visit);
+        case 12: return VisitRulesWidth<12>(variant, visit);
+        case 16: return VisitRulesWidth<16>(variant, visit);
+        default: return false;
+    }
+}
+
+// What the calculator displays: digits / 10^fractionDigits, at most DigitsInCalculator digits
+// and no trailing fractional zeros. Values above MaxCalculatorIntValue collapse to Overflow().
+struct CalculatorState {
+    uint64_t digits = 0;
+    int fractionDigits = 0;
+
+    static CalculatorState FromInt(uint64_t value, uint64_t maxValue = MaxCalculatorIntValue) {
+        return value > maxValue ? Overflow() : CalculatorState{ value, 0 };
+    }
+    static CalculatorState FromDisplay(uint64_t digits, int fractionDigits) {
+        while (fractionDigits > 0 && digits % 10 == 0) {
+            digits /= 10;
+            fractionDigits--;
+        }
+        return CalculatorState{ digits, fractionDigits };
+    }
+    static CalculatorState FromDouble(const double value);
+    static CalculatorState Overflow() { return CalculatorState{ UINT64_MAX, 0 }; }
+
+    bool IsOverflow() const { return digits == UINT64_MAX; }
+    bool IsInteger() const { return fractionDigits == 0; }
+    uint64_t GetIntPart() const { return digits / PowersOfTen[fractionDigits]; }
+    uint64_t GetFractionPart() const { return digits % PowersOfTen[fractionDigits]; }
+    double ToDouble() const { return IsOverflow() ? HUGE_VAL : static_cast<double>(digits) / PowersOfTen[fractionDigits]; }
+    std::string ToString() const;
+
+    bool operator==(const CalculatorState& other) const {
+        return digits == other.digits && fractionDigits == other.fractionDigits;
+    }
+    bool operator!=(const CalculatorState& other) const {
+        return !(*this == other);
+    }
+};
+
+// Rounds to the 15 significant digits a double holds and truncates that to the display,
+// so that 12.12 stored as 12.1199999 still reads 12.12.
+CalculatorState CalculatorState::FromDouble(const double value) {
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%.14e", value);
+    std::string significand = std::string(1, buffer[0]) + std::string(buffer + 2, 14);
+    int exponent = atoi(buffer + 17);
+    if (exponent >= DigitsInCalculator) {
+        return Overflow();
+    }
+    if (exponent < 0) {
+        significand = std::string(-exponent, '0') + significand;
+        exponent = 0;
+    }
+    return FromDisplay(std::stoull(significand.substr(0, DigitsInCalculator)), DigitsInCalculator - exponent - 1);
+}
+
+std::string CalculatorState::ToString() const {
+    if (IsOverflow()) {
+        return "overflow";
+    }
+    std::string text = std::to_string(GetIntPart());
+    if (!IsInteger()) {
+        std::string fraction = std::to_string(GetFractionPart());
+        text += "." + std::string(fractionDigits - fraction.size(), '0') + fraction;
+    }
+    return text;
+}
 
-double NextStep(const double n);
-double NextStepForInt(const double n);
-double NextStepForNonInt(const double n);
-bool HasTwoRepeatingDigits(const uint64_t num, uint64_t* valueAfterTwoRepeatingDigits);
-int main();
-void BreakFractionToIntAndFracPart(const double n, uint64_t* inPart, uint64_t* fractionPart, int* fractPartLeadingZerosCount);
+template <typename Rules = DefaultRules> CalculatorState NextStep(const CalculatorState& n);
+template <typename Rules = DefaultRules> CalculatorState NextStepForInt(const uint64_t n);
+template <typename Rules = DefaultRules> CalculatorState NextStepForNonInt(const CalculatorState& n);
+template <typename Rules = DefaultRules> bool HasTwoRepeatingDigits(const uint64_t num, uint64_t* valueAfterTwoRepeatingDigits);
+enum class StepRule : uint8_t { none, suffixDivisor, repeatingDigits, fractionMultiplier };
+template <typename Rules = DefaultRules> uint64_t GetStepOperand(const CalculatorState& n, StepRule* rule);
+template <typename Rules = DefaultRules> CalculatorState Divide(const uint64_t dividend, const uint64_t divisor);
+template <typename Rules = DefaultRules> CalculatorState Multiply(const CalculatorState& n, const uint64_t multiplier);
+uint64_t SuffixDivisor(const uint64_t num);
+uint64_t GetFractionStepMultiplier(const CalculatorState& n);
+int main(int argc, char* argv[]);
+void BreakFractionToIntAndFracPart(const CalculatorState& n, uint64_t* inPart, uint64_t* fractionPart, int* fractPartLeadingZerosCount);
 
 struct GameResults {
     GameResults() : startValue(0), outcome(GameOutcome::unknown), stepsCount(0), finalValue(std::nullopt) {}
-    GameResults(uint64_t _startValue, GameOutcome _outcome, int _stepsCount, std::optional<double> _finalValue) 
+    GameResults(uint64_t _startValue, GameOutcome _outcome, int _stepsCount, std::optional<CalculatorState> _finalValue) 
         : startValue(_startValue), outcome(_outcome), stepsCount(_stepsCount), finalValue(_finalValue) {}
     uint64_t startValue = 0;
     GameOutcome outcome = GameOutcome::unknown;
     int stepsCount = 0;
-    std::optional<double> finalValue = std::nullopt;
+    std::optional<CalculatorState> finalValue = std::nullopt;
+    // for cycle outcomes: the step the loop is entered at and its length, stepsCount is their sum
+    int cycleEntryStep = 0;
+    int cycleLength = 0;
 
     bool operator==(const GameResults& other) const
     {
@@ -42,64 +273,500 @@ private:
         return startValue == other.startValue
             && outcome == other.outcome
             && stepsCount == other.stepsCount
-            && finalValue == other.finalValue;
+            && finalValue == other.finalValue
+            && cycleEntryStep == other.cycleEntryStep
+            && cycleLength == other.cycleLength;
+    }
+};
+
+// Int states of the default rules below the bound finish with one lookup in the small value table, 0 while none is loaded.
+// Unrecorded scalar Play and the AVX-512 batch kernel take the lookup; other rules and recorded games do not.
+uint64_t SmallValueTableBound = 0;
+bool LookupSmallValue(uint64_t state, GameResults* results);
+
+struct CachedOutcome {
+    GameOutcome outcome = GameOutcome::unknown;
+    int stepsToEnd = 0;
+    std::optional<CalculatorState> finalValue = std::nullopt;
+};
+
+// Set-associative map from intermediate integer states to the rest of their game, shared between threads.
+// Buckets are guarded by striped locks and full buckets evict with a CLOCK hand.
+class TrajectoryCache {
+public:
+    explicit TrajectoryCache(size_t memoryBudgetBytes);
+    bool Lookup(uint64_t state, CachedOutcome* cached);
+    void Insert(uint64_t state, const CachedOutcome& cached);
+    size_t GetCapacity() const { return bucketCount_ * Ways; }
+    uint64_t GetHits() const;
+    uint64_t GetMisses() const;
+private:
+    static constexpr size_t Ways = 4;
+    static constexpr size_t StripeCount = 1024;
+    struct Entry {
+        uint64_t state = 0;
+        CalculatorState finalValue;
+        int32_t stepsToEnd = 0;
+        GameOutcome outcome = GameOutcome::unknown;
+        bool hasFinalValue = false;
+        bool referenced = false;
+    };
+    struct Bucket {
+        Entry entries[Ways];
+        uint8_t hand = 0;
+    };
+    struct alignas(64) Stripe {
+        std::mutex mutex;
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+    };
+    size_t BucketIndex(uint64_t state) const { return (state * 0x9E3779B97F4A7C15ull >> 16) % bucketCount_; }
+private:
+    size_t bucketCount_;
+    std::unique_ptr<Bucket[]> buckets_;
+    std::unique_ptr<Stripe[]> stripes_;
+};
+
+TrajectoryCache::TrajectoryCache(size_t memoryBudgetBytes)
+    : bucketCount_(std::max<size_t>(1, memoryBudgetBytes / sizeof(Bucket))),
+    buckets_(new Bucket[bucketCount_]),
+    stripes_(new Stripe[StripeCount]) {
+}
+
+bool TrajectoryCache::Lookup(uint64_t state, CachedOutcome* cached) {
+    size_t bucketIndex = BucketIndex(state);
+    Stripe& stripe = stripes_[bucketIndex % StripeCount];
+    std::lock_guard<std::mutex> lock(stripe.mutex);
+    for (Entry& entry : buckets_[bucketIndex].entries) {
+        if (entry.state == state) {
+            entry.referenced = true;
+            cached->outcome = entry.outcome;
+            cached->stepsToEnd = entry.stepsToEnd;
+            cached->finalValue = entry.hasFinalValue ? std::optional<CalculatorState>{ entry.finalValue } : std::nullopt;
+            stripe.hits++;
+            return true;
+        }
+    }
+    stripe.misses++;
+    return false;
+}
+
+void TrajectoryCache::Insert(uint64_t state, const CachedOutcome& cached) {
+    size_t bucketIndex = BucketIndex(state);
+    Stripe& stripe = stripes_[bucketIndex % StripeCount];
+    std::lock_guard<std::mutex> lock(stripe.mutex);
+    Bucket& bucket = buckets_[bucketIndex];
+    Entry* victim = nullptr;
+    for (Entry& entry : bucket.entries) {
+        if (entry.state == state || entry.state == 0) {
+            victim = &entry;
+            break;
+        }
+    }
+    while (victim == nullptr) {
+        Entry& entry = bucket.entries[bucket.hand];
+        bucket.hand = (bucket.hand + 1) % Ways;
+        if (entry.referenced) {
+            entry.referenced = false;
+        } else {
+            victim = &entry;
+        }
+    }
+    victim->state = state;
+    victim->finalValue = cached.finalValue.value_or(CalculatorState());
+    victim->stepsToEnd = cached.stepsToEnd;
+    victim->outcome = cached.outcome;
+    victim->hasFinalValue = cached.finalValue.has_value();
+    victim->referenced = false;
+}
+
+uint64_t TrajectoryCache::GetHits() const {
+    uint64_t hits = 0;
+    for (size_t i = 0; i < StripeCount; i++) {
+        std::lock_guard<std::mutex> lock(stripes_[i].mutex);
+        hits += stripes_[i].hits;
+    }
+    return hits;
+}
+
+uint64_t TrajectoryCache::GetMisses() const {
+    uint64_t misses = 0;
+    for (size_t i = 0; i < StripeCount; i++) {
+        std::lock_guard<std::mutex> lock(stripes_[i].mutex);
+        misses += stripes_[i].misses;
+    }
+    return misses;
+}
+
+// step instrumentation ///////////////////////////////////////////////////////////////////////////
+
+// Counts of the step functions' decisions, collected when InstrumentSteps is on. Each thread counts into
+// a block of its own and the blocks are merged for the report, once the threads are done counting.
+struct StepCounters {
+    static constexpr size_t HistogramSize = 21;
+
+    uint64_t intSteps = 0;
+    uint64_t fractionSteps = 0;
+    uint64_t repeatingDigitsHits = 0;       // the repeating digits rule picked the divisor
+    uint64_t suffixDivisorFallThroughs = 0; // the suffix divisor did
+    std::array<uint64_t, HistogramSize> suffixDivisorDigits{};     // digits the suffix divisor search went through
+    std::array<uint64_t, HistogramSize> fractionDigits{};          // fraction digits split off a fractional state
+    std::array<uint64_t, HistogramSize> multiplierExtensionDigits{}; // int digits a fraction of 1 pulled in
+
+    void Merge(const StepCounters& other);
+    void Print() const;
+};
+
+void StepCounters::Merge(const StepCounters& other) {
+    intSteps += other.intSteps;
+    fractionSteps += other.fractionSteps;
+    repeatingDigitsHits += other.repeatingDigitsHits;
+    suffixDivisorFallThroughs += other.suffixDivisorFallThroughs;
+    for (size_t i = 0; i < HistogramSize; i++) {
+        suffixDivisorDigits[i] += other.suffixDivisorDigits[i];
+        fractionDigits[i] += other.fractionDigits[i];
+        multiplierExtensionDigits[i] += other.multiplierExtensionDigits[i];
+    }
+}
+
+void StepCounters::Print() const {
+    auto percent = [](uint64_t count, uint64_t total) { return total == 0 ? 0.0 : 100.0 * count / total; };
+    auto printHistogram = [&](const char* name, const std::array<uint64_t, HistogramSize>& histogram) {
+        uint64_t total = std::accumulate(histogram.begin(), histogram.end(), uint64_t{ 0 });
+        std::cout << name;
+        for (size_t i = 0; i < HistogramSize; i++) {
+            if (histogram[i] != 0) {
+                std::cout << " " << i << ": " << percent(histogram[i], total) << "%";
+            }
+        }
+        std::cout << std::endl;
+    };
+    const uint64_t steps = intSteps + fractionSteps;
+    std::cout << "Steps " << steps << ", integer " << percent(intSteps, steps) << "%, fractional "
+        << percent(fractionSteps, steps) << "%" << std::endl;
+    std::cout << "Integer divisors: repeating digits rule " << percent(repeatingDigitsHits, intSteps)
+        << "%, suffix divisor " << percent(suffixDivisorFallThroughs, intSteps) << "%" << std::endl;
+    printHistogram("Suffix divisor digits", suffixDivisorDigits);
+    printHistogram("Fraction digits", fractionDigits);
+    printHistogram("Multiplier digits taken from the int part", multiplierExtensionDigits);
+}
+
+std::mutex StepCountersMutex;
+std::vector<std::unique_ptr<StepCounters>> AllStepCounters;
+
+// The calling thread's block, kept after the thread exits so that its counts make the report.
+StepCounters& GetStepCounters() {
+    thread_local StepCounters* counters = nullptr;
+    if (counters == nullptr) {
+        std::lock_guard<std::mutex> lock(StepCountersMutex);
+        AllStepCounters.emplace_back(new StepCounters());
+        counters = AllStepCounters.back().get();
+    }
+    return *counters;
+}
+
+StepCounters GetMergedStepCounters() {
+    std::lock_guard<std::mutex> lock(StepCountersMutex);
+    StepCounters merged;
+    for (const auto& counters : AllStepCounters) {
+        merged.Merge(*counters);
+    }
+    return merged;
+}
+
+void ResetStepCounters() {
+    std::lock_guard<std::mutex> lock(StepCountersMutex);
+    for (auto& counters : AllStepCounters) {
+        *counters = StepCounters();
+    }
+}
+
+// trajectory recording ///////////////////////////////////////////////////////////////////////////
+
+// One step of a recorded game: the state and the rule that moved it on, with its divisor or multiplier.
+// The last state of a game has rule none.
+struct TrajectoryStep {
+    uint64_t digits;
+    uint64_t operand;
+    uint8_t fractionDigits;
+    StepRule rule;
+
+    CalculatorState GetState() const { return CalculatorState{ digits, fractionDigits }; }
+};
+
+// Bump allocation out of one buffer allocated up front; Reset releases everything at once.
+class TrajectoryArena {
+public:
+    explicit TrajectoryArena(size_t capacityBytes) : buffer_(new uint8_t[capacityBytes]), capacity_(capacityBytes) {}
+    // nullptr once the buffer is used up
+    template <typename T>
+    T* Allocate(size_t count) {
+        size_t begin = (used_ + alignof(T) - 1) / alignof(T) * alignof(T);
+        if (begin + count * sizeof(T) > capacity_) {
+            return nullptr;
+        }
+        used_ = begin + count * sizeof(T);
+        return reinterpret_cast<T*>(buffer_.get() + begin);
     }
+    void Reset() { used_ = 0; }
+    size_t GetUsed() const { return used_; }
+private:
+    std::unique_ptr<uint8_t[]> buffer_;
+    size_t capacity_;
+    size_t used_ = 0;
+};
+
+// Play's recording policy when nothing is recorded, it compiles to nothing.
+struct NullRecorder {
+    static constexpr bool Enabled = false;
+    void BeginGame(uint64_t) {}
+    void RecordStep(const CalculatorState&, StepRule, uint64_t) {}
+};
+
+// Keeps the steps of the last game Play recorded. Games reuse the arena, so a thread can record any
+// number of them without allocating; a game longer than the arena keeps its first steps only.
+class TrajectoryRecorder {
+public:
+    static constexpr bool Enabled = true;
+    explicit TrajectoryRecorder(int maxMoves = MaxMoves) : arena_((maxMoves + 1) * sizeof(TrajectoryStep)) {}
+
+    void BeginGame(uint64_t) {
+        arena_.Reset();
+        steps_ = nullptr;
+        stepsCount_ = 0;
+        truncated_ = false;
+    }
+    void RecordStep(const CalculatorState& n, StepRule rule, uint64_t operand) {
+        TrajectoryStep* step = arena_.Allocate<TrajectoryStep>(1);
+        if (step == nullptr) {
+            truncated_ = true;
+            return;
+        }
+        *step = TrajectoryStep{ n.digits, operand, static_cast<uint8_t>(n.fractionDigits), rule };
+        steps_ = steps_ == nullptr ? step : steps_;
+        stepsCount_++;
+    }
+
+    const TrajectoryStep* GetSteps() const { return steps_; }
+    size_t GetStepsCount() const { return stepsCount_; }
+    bool IsTruncated() const { return truncated_; }
+private:
+    TrajectoryArena arena_;
+    TrajectoryStep* steps_ = nullptr;
+    size_t stepsCount_ = 0;
+    bool truncated_ = false;
 };
 
-GameResults Play(uint64_t num) {
+// Replays the game from num with a second pointer cycleLength steps ahead, they first meet at the cycle entry.
+template <typename Rules>
+void FindCycleEntry(uint64_t num, int cycleLength, GameResults* results) {
+    CalculatorState entry = CalculatorState::FromInt(num, Rules::MaxIntValue);
+    CalculatorState ahead = entry;
+    for (int i = 0; i < cycleLength; i++) {
+        ahead = NextStep<Rules>(ahead);
+    }
+    int entryStep = 0;
+    while (entry != ahead) {
+        entry = NextStep<Rules>(entry);
+        ahead = NextStep<Rules>(ahead);
+        entryStep++;
+    }
+    results->outcome = GameOutcome::cycle;
+    results->stepsCount = entryStep + cycleLength;
+    results->finalValue = std::optional<CalculatorState>{ entry };
+    results->cycleEntryStep = entryStep;
+    results->cycleLength = cycleLength;
+}
+
+// A cache must only be shared by games of the same rules. A recorder gets every step played; a recorded
+// game does not take the cache's or the small value table's shortcuts, so that its trajectory is complete.
+template <typename Rules = DefaultRules, typename Recorder = NullRecorder>
+GameResults Play(uint64_t num, TrajectoryCache* cache = nullptr, Recorder* recorder = nullptr) {
     GameResults results;
     results.startValue = num;
-    double n = static_cast<double>(num);
-    for (int moves = 0; moves < MaxMoves; moves++) {
-        if (n < 10) {
-            results.finalValue = std::optional<double>{ n };
+    CalculatorState n = CalculatorState::FromInt(num, Rules::MaxIntValue);
+    if constexpr (Recorder::Enabled) {
+        recorder->BeginGame(num);
+    }
+    std::pair<uint64_t, int> visitedIntStates[32];
+    size_t visitedIntStatesCount = 0;
+    // read once, so that steps compare against a register rather than load the global
+    const uint64_t smallValueTableBound = !Recorder::Enabled && std::is_same<Rules, DefaultRules>::value ? SmallValueTableBound : 0;
+    // Brent's cycle detection, the tortoise jumps to the current state every power of two steps
+    CalculatorState tortoise = n;
+    int power = 1;
+    int lambda = 0;
+    for (int moves = 0; moves < Rules::MaxMoves; moves++) {
+        if (n.GetIntPart() < 10) {
+            results.finalValue = std::optional<CalculatorState>{ n };
             results.outcome = GameOutcome::finished;
             break;
         }
-        if (n > MaxCalculatorIntValue) {
+        if (n.IsOverflow()) {
             results.outcome = GameOutcome::overflow;
             break;
         }
+        if (moves > 0 && n == tortoise) {
+            FindCycleEntry<Rules>(num, lambda, &results);
+            break;
+        }
+        if (power == lambda) {
+            tortoise = n;
+            power *= 2;
+            lambda = 0;
+        }
+        if constexpr (!Recorder::Enabled && std::is_same<Rules, DefaultRules>::value) {
+            // a cycle's entry step depends on where the game started, so only its ends are taken from the table
+            GameResults terminal;
+            if (n.digits < smallValueTableBound && n.IsInteger() && LookupSmallValue(n.digits, &terminal)
+                && (terminal.outcome == GameOutcome::finished || terminal.outcome == GameOutcome::overflow)
+                && results.stepsCount + terminal.stepsCount < Rules::MaxMoves) {
+                results.outcome = terminal.outcome;
+                results.stepsCount += terminal.stepsCount;
+                results.finalValue = terminal.finalValue;
+                break;
+            }
+        }
+        if (!Recorder::Enabled && cache != nullptr && n.IsInteger()) {
+            uint64_t state = n.digits;
+            CachedOutcome cached;
+            if (cache->Lookup(state, &cached) && results.stepsCount + cached.stepsToEnd < Rules::MaxMoves) {
+                results.outcome = cached.outcome;
+                results.stepsCount += cached.stepsToEnd;
+                results.finalValue = cached.finalValue;
+                break;
+            }
+            if (visitedIntStatesCount < std::size(visitedIntStates)) {
+                visitedIntStates[visitedIntStatesCount++] = { state, results.stepsCount };
+            }
+        }
         results.stepsCount++;
-        n = NextStep(n);
+        if constexpr (Recorder::Enabled) {
+            StepRule rule;
+            uint64_t operand = GetStepOperand<Rules>(n, &rule);
+            recorder->RecordStep(n, rule, operand);
+            n = n.IsInteger() ? Divide<Rules>(n.digits, operand) : Multiply<Rules>(n, operand);
+        } else {
+            n = NextStep<Rules>(n);
+        }
+        lambda++;
+    }
+    if (results.outcome == GameOutcome::unknown) {
+        results.outcome = GameOutcome::tooManyMoves;
+    }
+    if constexpr (Recorder::Enabled) {
+        recorder->RecordStep(n, StepRule::none, 0);
+    }
+    if (results.outcome == GameOutcome::finished || results.outcome == GameOutcome::overflow) {
+        for (size_t i = 0; i < visitedIntStatesCount; i++) {
+            cache->Insert(visitedIntStates[i].first,
+                CachedOutcome{ results.outcome, results.stepsCount - visitedIntStates[i].second, results.finalValue });
+        }
     }
     return results;
 }
 
-double NextStep(const double n) {
-    double intpart;
-    bool isInteger = (modf(n, &intpart) == 0.0);
-    return isInteger ? NextStepForInt(n) : NextStepForNonInt(n);
+template <typename Rules>
+CalculatorState NextStep(const CalculatorState& n) {
+    if constexpr (InstrumentSteps) {
+        (n.IsInteger() ? GetStepCounters().intSteps : GetStepCounters().fractionSteps)++;
+    }
+    return n.IsInteger() ? NextStepForInt<Rules>(n.digits) : NextStepForNonInt<Rules>(n);
 }
 
-double NextStepForInt(const double n) {
-    if (n < 10) {
-        return n;
+template <typename Rules>
+CalculatorState Divide(const uint64_t dividend, const uint64_t divisor) {
+    uint64_t quotient = dividend / divisor;
+    uint64_t remainder = dividend % divisor;
+    int fractionDigits = Rules::Digits - DigitsCountUpTo<Rules::Digits>(quotient);
+    uint64_t scale = PowersOfTen[fractionDigits];
+    uint64_t fraction;
+    if constexpr (Rules::Digits <= 10) {
+        fraction = remainder * scale / divisor;
+    } else {
+        uint64_t unused;
+        fraction = MulDivMod(remainder, scale, divisor, &unused);
+    }
+    return CalculatorState::FromDisplay(quotient * scale + fraction, fractionDigits);
+}
+
+template <typename Rules>
+CalculatorState Multiply(const CalculatorState& n, const uint64_t multiplier) {
+    uint64_t intPart = n.GetIntPart();
+    if (intPart != 0 && multiplier > Rules::MaxIntValue / intPart) {
+        return CalculatorState::Overflow();
+    }
+    uint64_t scale = PowersOfTen[n.fractionDigits];
+    uint64_t fractionCarry;
+    uint64_t productFraction;
+    if constexpr (Rules::Digits <= 10) {
+        uint64_t scaledFraction = n.GetFractionPart() * multiplier;
+        fractionCarry = scaledFraction / scale;
+        productFraction = scaledFraction % scale;
+    } else {
+        fractionCarry = MulDivMod(n.GetFractionPart(), multiplier, scale, &productFraction);
+    }
+    uint64_t productIntPart = intPart * multiplier + fractionCarry;
+    if (productIntPart > Rules::MaxIntValue || (productIntPart == Rules::MaxIntValue && productFraction != 0)) {
+        return CalculatorState::Overflow();
     }
-    uint64_t num = (uint64_t)n;
-    if (ImplementTwoRepeatingDigitsRule) {
+    int fractionDigits = std::min(n.fractionDigits, Rules::Digits - DigitsCountUpTo<Rules::Digits>(productIntPart));
+    uint64_t truncatedFraction = productFraction / PowersOfTen[n.fractionDigits - fractionDigits];
+    return CalculatorState::FromDisplay(productIntPart * PowersOfTen[fractionDigits] + truncatedFraction, fractionDigits);
+}
+
+// The divisor of an integer n >= 10 and the rule that picks it.
+template <typename Rules>
+uint64_t GetIntStepDivisor(const uint64_t n, StepRule* rule) {
+    if constexpr (Rules::RepeatingDigitsRule) {
         uint64_t valueAfterTwoRepeatingDigits = 0;
-        bool hasTwoRepeatingDigits = HasTwoRepeatingDigits(num, &valueAfterTwoRepeatingDigits);
+        bool hasTwoRepeatingDigits = HasTwoRepeatingDigits<Rules>(n, &valueAfterTwoRepeatingDigits);
         if (hasTwoRepeatingDigits && valueAfterTwoRepeatingDigits != 0) {
-            return n / valueAfterTwoRepeatingDigits;
+            if constexpr (InstrumentSteps) {
+                GetStepCounters().repeatingDigitsHits++;
+            }
+            *rule = StepRule::repeatingDigits;
+            return valueAfterTwoRepeatingDigits;
         }
     }
-    uint64_t divideBy = 0;
-    uint64_t multiplier = 1;
-    while ((divideBy == 0 || divideBy == 1) && (divideBy < n)) {
-        int digit = num % 10;
-        divideBy += digit * multiplier;
-        num /= 10;
-        multiplier *= 10;
+    *rule = StepRule::suffixDivisor;
+    const uint64_t divisor = SuffixDivisor(n);
+    if constexpr (InstrumentSteps) {
+        StepCounters& counters = GetStepCounters();
+        counters.suffixDivisorFallThroughs++;
+        counters.suffixDivisorDigits[DigitsCount(divisor)]++;
+    }
+    return divisor;
+}
+
+template <typename Rules>
+uint64_t GetStepOperand(const CalculatorState& n, StepRule* rule) {
+    if (n.IsInteger()) {
+        return GetIntStepDivisor<Rules>(n.digits, rule);
+    }
+    *rule = StepRule::fractionMultiplier;
+    return GetFractionStepMultiplier(n);
+}
+
+template <typename Rules>
+CalculatorState NextStepForInt(const uint64_t n) {
+    if (n < 10) {
+        return CalculatorState::FromInt(n);
     }
-    return n / divideBy;
+    StepRule rule;
+    return Divide<Rules>(n, GetIntStepDivisor<Rules>(n, &rule));
 }
 
-double NextStepForNonInt(const double n) {
-    if (n < 10 || n > MaxCalculatorIntValue) {
+template <typename Rules>
+CalculatorState NextStepForNonInt(const CalculatorState& n) {
+    if (n.GetIntPart() < 10 || n.IsOverflow()) {
         return n;
     }
+    return Multiply<Rules>(n, GetFractionStepMultiplier(n));
+}
 
+// The multiplier of a non-integer state with an int part of 10 or more.
+uint64_t GetFractionStepMultiplier(const CalculatorState& n) {
     uint64_t intPart;
     uint64_t fractionPart;
     int fractPartLeadingZerosCount;
@@ -109,62 +776,150 @@ double NextStepForNonInt(const double n) {
     while (fractPartLeadingZerosCount-- > 0) {
         exponent *= 10;
     }
+    int extensionDigits = 0;
     while (multipler < 2) {
         exponent *= 10;
         multipler += (exponent * (intPart % 10));
         intPart /= 10;
+        extensionDigits++;
     }
-    return n * multipler;
-}
-
-void BreakFractionToIntAndFracPart(const double n, uint64_t* intPart, uint64_t* fractionPart, int *fractPartLeadingZerosCount) {
-    double _intPart;
-    double _fractionPart = modf(n, &_intPart);
-    int intPartDigits = static_cast<int>(_intPart < 10 ? 1 : log10(_intPart) + 1);
-    int truncatedFractPartDigits = DigitsInCalculator - intPartDigits;
-    int64_t truncatedFractPart = 0;
-
-    int _fractPartLeadingZerosCount = 0;
-    bool encounteredNonZeroDigit = false;
-    while (truncatedFractPartDigits > 0) {
-        _fractionPart *= 10;
-        double _fractionPartRound = round(_fractionPart);
-        int nextFracDigit;
-        if (abs(_fractionPartRound - _fractionPart) < 0.001) {
-            // Handle rare cases if examples like 12.12 represented as 12.119999999 due to precision limits of double.
-            nextFracDigit = static_cast<int>(_fractionPartRound);
-        } else {
-            nextFracDigit = static_cast<int>(floor(_fractionPart));
-        }
+    if constexpr (InstrumentSteps) {
+        StepCounters& counters = GetStepCounters();
+        counters.fractionDigits[n.fractionDigits]++;
+        counters.multiplierExtensionDigits[extensionDigits]++;
+    }
+    return multipler;
+}
+
+void BreakFractionToIntAndFracPart(const CalculatorState& n, uint64_t* intPart, uint64_t* fractionPart, int *fractPartLeadingZerosCount) {
+    *intPart = n.GetIntPart();
+    *fractionPart = n.GetFractionPart();
+    *fractPartLeadingZerosCount = (*fractionPart == 0) ? 0 : n.fractionDigits - DigitsCount(*fractionPart);
+}
 
-        if (nextFracDigit == 0) {
-            if (!encounteredNonZeroDigit) {
-                _fractPartLeadingZerosCount++;
+// digit tables ///////////////////////////////////////////////////////////////////////////////////
+
+// Per 4-digit chunk facts, so a 10-digit value is decided from three lookups instead of a digit loop.
+struct DigitChunk {
+    uint16_t suffixes[4] = {};      // chunk % 10^k for k = 0..3
+    uint16_t divisor = 0;           // shortest suffix above one, 0 if there is none
+    uint16_t nonZeroSuffix = 0;     // shortest nonzero suffix, 0 for the zero chunk
+    uint8_t repeatMask = 0;         // bit j set when digit j equals digit j + 1, digit 0 is the lowest
+    uint8_t lowDigit = 0;
+    uint8_t highDigit = 0;
+    uint8_t digitsCount = 0;        // significant digits, 0 for the zero chunk
+};
+
+constexpr uint64_t DigitChunkSize = 10000;
+
+constexpr std::array<DigitChunk, DigitChunkSize> MakeDigitChunks() {
+    std::array<DigitChunk, DigitChunkSize> chunks{};
+    for (uint64_t value = 0; value < DigitChunkSize; value++) {
+        DigitChunk& chunk = chunks[value];
+        uint64_t digits[4] = { value % 10, value / 10 % 10, value / 100 % 10, value / 1000 };
+        for (int k = 0; k < 4; k++) {
+            chunk.suffixes[k] = static_cast<uint16_t>(value % PowersOfTen[k]);
+        }
+        for (int k = 0; k < 3; k++) {
+            if (digits[k] == digits[k + 1]) {
+                chunk.repeatMask |= static_cast<uint8_t>(1 << k);
             }
-        } else {
-            encounteredNonZeroDigit = true;
         }
-
-        _fractionPart -= nextFracDigit;
-        truncatedFractPart *= 10;
-        truncatedFractPart += nextFracDigit;
-        if (_fractionPart < 0.001) {
-            break;
+        for (int k = 4; k >= 1; k--) {
+            uint64_t suffix = value % PowersOfTen[k];
+            if (suffix >= 2) {
+                chunk.divisor = static_cast<uint16_t>(suffix);
+            }
+            if (suffix != 0) {
+                chunk.nonZeroSuffix = static_cast<uint16_t>(suffix);
+            }
+        }
+        chunk.lowDigit = static_cast<uint8_t>(digits[0]);
+        chunk.highDigit = static_cast<uint8_t>(digits[3]);
+        while (chunk.digitsCount < 4 && value >= PowersOfTen[chunk.digitsCount]) {
+            chunk.digitsCount++;
         }
-        truncatedFractPartDigits--;
     }
+    return chunks;
+}
 
-    *intPart = static_cast<uint64_t>(_intPart);
-    *fractionPart = static_cast<uint64_t>(truncatedFractPart);
-    *fractPartLeadingZerosCount = _fractPartLeadingZerosCount;
+static constexpr std::array<DigitChunk, DigitChunkSize> DigitChunks = MakeDigitChunks();
+
+int HighestBit(uint32_t mask) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse(&index, mask);
+    return static_cast<int>(index);
+#else
+    return 31 - __builtin_clz(mask);
+#endif
 }
 
+template <typename Rules>
 bool HasTwoRepeatingDigits(const uint64_t num, uint64_t* valueAfterTwoRepeatingDigits) {
     *valueAfterTwoRepeatingDigits = 0;
     if (num < 1000) {
         return false;
     }
-    if (num > MaxCalculatorIntValue) {
+    if (num > Rules::MaxIntValue) {
+        return false;
+    }
+
+    constexpr int ChunksCount = (Rules::Digits + 3) / 4;
+    uint64_t chunkValues[ChunksCount];
+    const DigitChunk* chunks[ChunksCount];
+    uint64_t rest = num;
+    for (int i = 0; i < ChunksCount; i++) {
+        chunkValues[i] = rest % DigitChunkSize;
+        chunks[i] = &DigitChunks[chunkValues[i]];
+        rest /= DigitChunkSize;
+    }
+    int digitsCount = 0;
+    uint32_t repeats = 0;
+    for (int i = 0; i < ChunksCount; i++) {
+        digitsCount = chunks[i]->digitsCount != 0 ? 4 * i + chunks[i]->digitsCount : digitsCount;
+        repeats |= static_cast<uint32_t>(chunks[i]->repeatMask) << (4 * i);
+        if (i + 1 < ChunksCount) {
+            repeats |= static_cast<uint32_t>(chunks[i]->highDigit == chunks[i + 1]->lowDigit) << (4 * i + 3);
+        }
+    }
+    // the pair must sit below the top digit and above the last one
+    repeats &= (1u << (digitsCount - 1)) - 2;
+    if (repeats == 0) {
+        return false;
+    }
+    int position = HighestBit(repeats);
+    uint64_t value = chunks[position / 4]->suffixes[position % 4];
+    for (int i = position / 4 - 1; i >= 0; i--) {
+        value = value * DigitChunkSize + chunkValues[i];
+    }
+    *valueAfterTwoRepeatingDigits = value;
+    return *valueAfterTwoRepeatingDigits > 1;
+}
+
+// The shortest suffix of num above one, num must be at least 10.
+uint64_t SuffixDivisor(const uint64_t num) {
+    uint64_t lowChunk = num % DigitChunkSize;
+    if (DigitChunks[lowChunk].divisor != 0) {
+        return DigitChunks[lowChunk].divisor;
+    }
+    uint64_t rest = num / DigitChunkSize;
+    uint64_t scale = DigitChunkSize;
+    while (rest % DigitChunkSize == 0) {
+        rest /= DigitChunkSize;
+        scale *= DigitChunkSize;
+    }
+    return DigitChunks[rest % DigitChunkSize].nonZeroSuffix * scale + lowChunk;
+}
+
+// Digit loop versions the tables replaced, kept as the reference for tests and bench-digits.
+bool HasTwoRepeatingDigitsByLoop(const uint64_t num, uint64_t* valueAfterTwoRepeatingDigits,
+    const uint64_t maxValue = MaxCalculatorIntValue) {
+    *valueAfterTwoRepeatingDigits = 0;
+    if (num < 1000) {
+        return false;
+    }
+    if (num > maxValue) {
         return false;
     }
 
@@ -185,97 +940,4847 @@ bool HasTwoRepeatingDigits(const uint64_t num, uint64_t* valueAfterTwoRepeatingD
         else {
             prevDigit = std::optional<uint64_t>{ digit };
         }
-        truncatedNum -= (digit * multipler);
-        multipler /= 10;
+        truncatedNum -= (digit * multipler);
+        multipler /= 10;
+    }
+    return false;
+}
+
+uint64_t SuffixDivisorByLoop(const uint64_t n) {
+    uint64_t num = n;
+    uint64_t divideBy = 0;
+    uint64_t multiplier = 1;
+    while ((divideBy == 0 || divideBy == 1) && (divideBy < n)) {
+        int digit = num % 10;
+        divideBy += digit * multiplier;
+        num /= 10;
+        multiplier *= 10;
+    }
+    return divideBy;
+}
+
+// batched play kernel ////////////////////////////////////////////////////////////////////////////
+
+void PlayBatchScalar(const uint64_t* startValues, size_t count, GameResults* results) {
+    for (size_t i = 0; i < count; i++) {
+        results[i] = Play(startValues[i]);
+    }
+}
+
+#ifdef CALCGAME_AVX512_KERNEL
+bool CpuSupportsAvx512() {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuidex(info, 7, 0);
+    bool hasAvx512 = (info[1] & (1 << 16)) != 0 && (info[1] & (1 << 17)) != 0;
+    __cpuid(info, 1);
+    bool hasXsave = (info[2] & (1 << 27)) != 0;
+    return hasAvx512 && hasXsave && (_xgetbv(0) & 0xE6) == 0xE6;
+#else
+    return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq");
+#endif
+}
+
+// Eight games advance in lockstep, one per 64-bit lane. Every value the game produces stays below 2^53,
+// so the lanes hold doubles and each division is exact: the rounded quotient of two such integers floors
+// to the exact one. Products that would not fit in 53 bits are split into two exact halves.
+struct Avx512Lanes {
+    __m512d pow10Lo, pow10Hi, invPow10Lo, invPow10Hi;
+    __m512d pow10Broadcast[DigitsInCalculator + 1];
+    __m512d invPow10Broadcast[DigitsInCalculator + 1];
+
+    CALCGAME_TARGET_AVX512 Avx512Lanes() {
+        double pow10[16];
+        double invPow10[16];
+        for (int i = 0; i < 16; i++) {
+            pow10[i] = static_cast<double>(PowersOfTen[i]);
+            invPow10[i] = 1.0 / pow10[i];
+        }
+        pow10Lo = _mm512_loadu_pd(pow10);
+        pow10Hi = _mm512_loadu_pd(pow10 + 8);
+        invPow10Lo = _mm512_loadu_pd(invPow10);
+        invPow10Hi = _mm512_loadu_pd(invPow10 + 8);
+        for (int i = 0; i <= DigitsInCalculator; i++) {
+            pow10Broadcast[i] = _mm512_set1_pd(pow10[i]);
+            invPow10Broadcast[i] = _mm512_set1_pd(invPow10[i]);
+        }
+    }
+
+    CALCGAME_TARGET_AVX512 __m512d Pow10(__m512i exponent) const {
+        return _mm512_permutex2var_pd(pow10Lo, exponent, pow10Hi);
+    }
+
+    CALCGAME_TARGET_AVX512 __m512d InvPow10(__m512i exponent) const {
+        return _mm512_permutex2var_pd(invPow10Lo, exponent, invPow10Hi);
+    }
+
+    static CALCGAME_TARGET_AVX512 __m512d FloorDiv(__m512d dividend, __m512d divisor) {
+        __m512d quotient = _mm512_div_pd(dividend, divisor);
+        return _mm512_mask_roundscale_pd(quotient, 0xFF, quotient, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+    }
+
+    // Exact for dividends below 2^51: the half offset keeps the rounded product of an exact multiple
+    // from landing just under the integer, and stays smaller than the gap to the next one.
+    static CALCGAME_TARGET_AVX512 __m512d FloorDivPow10(__m512d dividend, __m512d pow10, __m512d invPow10, __m512d* remainder) {
+        __m512d quotient = _mm512_mul_pd(_mm512_add_pd(dividend, _mm512_set1_pd(0.5)), invPow10);
+        quotient = _mm512_mask_roundscale_pd(quotient, 0xFF, quotient, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+        *remainder = _mm512_fnmadd_pd(quotient, pow10, dividend);
+        return quotient;
+    }
+
+    // The binary exponent pins the decimal digit count down to two candidates; one compare picks between them.
+    CALCGAME_TARGET_AVX512 __m512i DigitsCount(__m512d value) const {
+        __m512d exponent = _mm512_mask_getexp_pd(value, 0xFF, value);
+        __m512d lowerLog10 = _mm512_mul_pd(exponent, _mm512_set1_pd(0.30102999566398120));
+        __m512i digits = _mm512_add_epi64(_mm512_mask_cvttpd_epi64(_mm512_setzero_si512(), 0xFF, lowerLog10), _mm512_set1_epi64(1));
+        __mmask8 oneMore = _mm512_cmp_pd_mask(value, Pow10(digits), _CMP_GE_OQ);
+        return _mm512_mask_add_epi64(digits, oneMore, digits, _mm512_set1_epi64(1));
+    }
+
+    // Lanes whose game ends before the next move: finished, overflowed or out of moves.
+    CALCGAME_TARGET_AVX512 __mmask8 EndedMask(__m512d digits, __m512i fractionDigits, __m512i steps) const {
+        __m512i intPartLimit = _mm512_add_epi64(fractionDigits, _mm512_set1_epi64(1));
+        return _mm512_cmp_pd_mask(digits, Pow10(intPartLimit), _CMP_LT_OQ)
+            | _mm512_cmp_pd_mask(digits, _mm512_set1_pd(static_cast<double>(MaxCalculatorIntValue)), _CMP_GT_OQ)
+            | _mm512_cmpeq_epi64_mask(steps, _mm512_set1_epi64(MaxMoves));
+    }
+
+    // Lanes that came back to their Brent tortoise state, these are looping.
+    CALCGAME_TARGET_AVX512 __mmask8 CycleMask(__m512d digits, __m512i fractionDigits, __m512i steps,
+        __m512d tortoiseDigits, __m512i tortoiseFractionDigits) const {
+        return _mm512_cmp_pd_mask(digits, tortoiseDigits, _CMP_EQ_OQ)
+            & _mm512_cmpeq_epi64_mask(fractionDigits, tortoiseFractionDigits)
+            & _mm512_cmpneq_epi64_mask(steps, _mm512_setzero_si512());
+    }
+
+    // Lanes on an int state below the small value table's bound.
+    static CALCGAME_TARGET_AVX512 __mmask8 TableMask(__m512d digits, __m512i fractionDigits, __m512d tableBound) {
+        return _mm512_cmp_pd_mask(digits, tableBound, _CMP_LT_OQ) & _mm512_cmpeq_epi64_mask(fractionDigits, _mm512_setzero_si512());
+    }
+
+    // One NextStep for every lane; lanes that overflow come back above MaxCalculatorIntValue.
+    CALCGAME_TARGET_AVX512 void Step(__m512d* digits, __m512i* fractionDigits) const {
+        const __m512d x = *digits;
+        const __m512i f = *fractionDigits;
+        const __m512d zero = _mm512_setzero_pd();
+        const __m512d two = _mm512_set1_pd(2.0);
+        const __m512d ten = _mm512_set1_pd(10.0);
+        const __m512d maxValue = _mm512_set1_pd(static_cast<double>(MaxCalculatorIntValue));
+        const __m512i calculatorDigits = _mm512_set1_epi64(DigitsInCalculator);
+
+        __m512d truncated[DigitsInCalculator + 1];
+        __m512d suffix[DigitsInCalculator + 1];
+        truncated[0] = x;
+        suffix[0] = zero;
+        CALCGAME_UNROLL
+        for (int k = 1; k <= DigitsInCalculator; k++) {
+            truncated[k] = FloorDivPow10(x, pow10Broadcast[k], invPow10Broadcast[k], &suffix[k]);
+        }
+        __m512i digitsCount = DigitsCount(x);
+
+        // Integer branch: the repeating-digit divisor, else the shortest suffix above one.
+        __m512d repeatValue = zero;
+        __mmask8 hasRepeat = 0;
+        CALCGAME_UNROLL
+        for (int j = 1; j <= DigitsInCalculator - 2; j++) {
+            __m512d digit = _mm512_fnmadd_pd(ten, truncated[j + 1], truncated[j]);
+            __m512d nextDigit = _mm512_fnmadd_pd(ten, truncated[j + 2], truncated[j + 1]);
+            __mmask8 repeats = _mm512_cmp_pd_mask(digit, nextDigit, _CMP_EQ_OQ)
+                & _mm512_cmpge_epi64_mask(digitsCount, _mm512_set1_epi64(j + 2));
+            repeatValue = _mm512_mask_mov_pd(repeatValue, repeats, suffix[j]);
+            hasRepeat |= repeats;
+        }
+        __mmask8 useRepeat = ImplementTwoRepeatingDigitsRule
+            ? hasRepeat & _mm512_cmpge_epi64_mask(digitsCount, _mm512_set1_epi64(4)) & _mm512_cmp_pd_mask(repeatValue, _mm512_set1_pd(1.0), _CMP_GT_OQ)
+            : 0;
+        __m512d suffixDivisor = x;
+        __m512d suffixMultiplier = x;
+        CALCGAME_UNROLL
+        for (int k = DigitsInCalculator - 1; k >= 1; k--) {
+            __mmask8 aboveOne = _mm512_cmp_pd_mask(suffix[k], two, _CMP_GE_OQ);
+            suffixDivisor = _mm512_mask_mov_pd(suffixDivisor, aboveOne, suffix[k]);
+            suffixMultiplier = _mm512_mask_mov_pd(suffixMultiplier, aboveOne & _mm512_cmple_epi64_mask(f, _mm512_set1_epi64(k)), suffix[k]);
+        }
+        __m512d divisor = _mm512_mask_mov_pd(suffixDivisor, useRepeat, repeatValue);
+        __m512d quotient = FloorDiv(x, divisor);
+        __m512d remainder = _mm512_fnmadd_pd(quotient, divisor, x);
+        __m512i quotientFractionDigits = _mm512_sub_epi64(calculatorDigits, DigitsCount(quotient));
+        __m512i firstFractionDigits = _mm512_mask_min_epi64(quotientFractionDigits, 0xFF, quotientFractionDigits, _mm512_set1_epi64(5));
+        __m512i secondFractionDigits = _mm512_sub_epi64(quotientFractionDigits, firstFractionDigits);
+        __m512d scaled = _mm512_mul_pd(remainder, Pow10(firstFractionDigits));
+        __m512d fractionHigh = FloorDiv(scaled, divisor);
+        scaled = _mm512_mul_pd(_mm512_fnmadd_pd(fractionHigh, divisor, scaled), Pow10(secondFractionDigits));
+        __m512d fractionLow = FloorDiv(scaled, divisor);
+        __m512d intResult = _mm512_fmadd_pd(quotient, Pow10(quotientFractionDigits),
+            _mm512_fmadd_pd(fractionHigh, Pow10(secondFractionDigits), fractionLow));
+
+        // Fractional branch: multiply by the shortest suffix above one that covers the fraction.
+        __m512d fractionScale = Pow10(f);
+        __m512d fractionInvScale = InvPow10(f);
+        __m512d fraction;
+        __m512d intPart = FloorDivPow10(x, fractionScale, fractionInvScale, &fraction);
+        __m512d multiplierLow;
+        __m512d multiplierHigh = FloorDivPow10(suffixMultiplier, pow10Broadcast[5], invPow10Broadcast[5], &multiplierLow);
+        __m512d highRemainder;
+        __m512d highQuotient = FloorDivPow10(_mm512_mul_pd(fraction, multiplierHigh), fractionScale, fractionInvScale, &highRemainder);
+        __m512d productFraction;
+        __m512d lowQuotient = FloorDivPow10(_mm512_fmadd_pd(highRemainder, pow10Broadcast[5], _mm512_mul_pd(fraction, multiplierLow)),
+            fractionScale, fractionInvScale, &productFraction);
+        __m512d intProduct = _mm512_mul_pd(intPart, suffixMultiplier);
+        __m512d productIntPart = _mm512_add_pd(intProduct, _mm512_fmadd_pd(highQuotient, pow10Broadcast[5], lowQuotient));
+        __mmask8 overflows = _mm512_cmp_pd_mask(intProduct, maxValue, _CMP_GT_OQ)
+            | _mm512_cmp_pd_mask(productIntPart, maxValue, _CMP_GT_OQ)
+            | (_mm512_cmp_pd_mask(productIntPart, maxValue, _CMP_EQ_OQ) & _mm512_cmp_pd_mask(productFraction, zero, _CMP_NEQ_OQ));
+        __m512i productFractionDigits = _mm512_mask_min_epi64(f, 0xFF, f, _mm512_sub_epi64(calculatorDigits, DigitsCount(productIntPart)));
+        __m512i droppedDigits = _mm512_sub_epi64(f, productFractionDigits);
+        __m512d droppedRemainder;
+        __m512d keptFraction = FloorDivPow10(productFraction, Pow10(droppedDigits), InvPow10(droppedDigits), &droppedRemainder);
+        __m512d fractionResult = _mm512_fmadd_pd(productIntPart, Pow10(productFractionDigits), keptFraction);
+
+        __mmask8 isInteger = _mm512_cmpeq_epi64_mask(f, _mm512_setzero_si512());
+        __m512d next = _mm512_mask_mov_pd(fractionResult, isInteger, intResult);
+        __m512i nextFractionDigits = _mm512_mask_mov_epi64(productFractionDigits, isInteger, quotientFractionDigits);
+        CALCGAME_UNROLL
+        for (int strip = 8; strip >= 1; strip /= 2) {
+            __m512d stripRemainder;
+            __m512d stripped = FloorDivPow10(next, pow10Broadcast[strip], invPow10Broadcast[strip], &stripRemainder);
+            __mmask8 canStrip = _mm512_cmp_pd_mask(stripRemainder, zero, _CMP_EQ_OQ)
+                & _mm512_cmpge_epi64_mask(nextFractionDigits, _mm512_set1_epi64(strip));
+            next = _mm512_mask_mov_pd(next, canStrip, stripped);
+            nextFractionDigits = _mm512_mask_sub_epi64(nextFractionDigits, canStrip, nextFractionDigits, _mm512_set1_epi64(strip));
+        }
+        overflows &= ~isInteger;
+        *digits = _mm512_mask_mov_pd(next, overflows, _mm512_set1_pd(1e300));
+        *fractionDigits = _mm512_mask_mov_epi64(nextFractionDigits, overflows, _mm512_setzero_si512());
+    }
+};
+
+CALCGAME_TARGET_AVX512 void PlayBatchAvx512(const uint64_t* startValues, size_t count, GameResults* results) {
+    // Several independent groups of eight lanes keep the divider busy while one group waits on its chain.
+    constexpr int Groups = 2;
+    constexpr int Lanes = 8;
+    static_assert(DigitsInCalculator <= 15, "lane values must stay exact in a double");
+    const Avx512Lanes lanes;
+    alignas(64) double digits[Groups][Lanes];
+    alignas(64) int64_t fractionDigits[Groups][Lanes];
+    alignas(64) int64_t steps[Groups][Lanes];
+    size_t slots[Groups][Lanes];
+    __mmask8 active[Groups] = {};
+    __m512d laneDigits[Groups];
+    __m512i laneFractionDigits[Groups];
+    __m512i laneSteps[Groups];
+    // lane-wise Brent cycle detection, see Play
+    __m512d tortoiseDigits[Groups];
+    __m512i tortoiseFractionDigits[Groups];
+    __m512i power[Groups];
+    __m512i lambda[Groups];
+    // lanes that reach an int state below the bound retire with a lookup in the small value table, as Play does
+    const uint64_t smallValueTableBound = SmallValueTableBound;
+    const __m512d tableBound = _mm512_set1_pd(static_cast<double>(smallValueTableBound));
+    size_t next = 0;
+
+    auto load = [&](int group, int lane) {
+        if (next < count) {
+            uint64_t value = startValues[next];
+            digits[group][lane] = value > MaxCalculatorIntValue ? 1e300 : static_cast<double>(value);
+            fractionDigits[group][lane] = 0;
+            steps[group][lane] = 0;
+            slots[group][lane] = next++;
+            active[group] |= static_cast<__mmask8>(1 << lane);
+        } else {
+            active[group] &= static_cast<__mmask8>(~(1 << lane));
+        }
+    };
+    for (int group = 0; group < Groups; group++) {
+        for (int lane = 0; lane < Lanes; lane++) {
+            digits[group][lane] = 0;
+            fractionDigits[group][lane] = 0;
+            steps[group][lane] = 0;
+            load(group, lane);
+        }
+        laneDigits[group] = _mm512_load_pd(digits[group]);
+        laneFractionDigits[group] = _mm512_load_si512(fractionDigits[group]);
+        laneSteps[group] = _mm512_load_si512(steps[group]);
+        tortoiseDigits[group] = laneDigits[group];
+        tortoiseFractionDigits[group] = laneFractionDigits[group];
+        power[group] = _mm512_set1_epi64(1);
+        lambda[group] = _mm512_setzero_si512();
+    }
+
+    for (bool anyActive = true; anyActive;) {
+        anyActive = false;
+        for (int group = 0; group < Groups; group++) {
+            auto endedMask = [&]() {
+                return lanes.EndedMask(laneDigits[group], laneFractionDigits[group], laneSteps[group])
+                    | lanes.CycleMask(laneDigits[group], laneFractionDigits[group], laneSteps[group], tortoiseDigits[group], tortoiseFractionDigits[group])
+                    | lanes.TableMask(laneDigits[group], laneFractionDigits[group], tableBound);
+            };
+            __mmask8 retired = 0;
+            for (__mmask8 ended = endedMask() & active[group]; ended != 0; ended = endedMask() & active[group] & ended) {
+                retired |= ended;
+                _mm512_store_pd(digits[group], laneDigits[group]);
+                _mm512_store_si512(fractionDigits[group], laneFractionDigits[group]);
+                _mm512_store_si512(steps[group], laneSteps[group]);
+                for (int lane = 0; lane < Lanes; lane++) {
+                    if ((ended & (1 << lane)) == 0) {
+                        continue;
+                    }
+                    bool overflow = digits[group][lane] > MaxCalculatorIntValue;
+                    CalculatorState n = overflow ? CalculatorState::Overflow()
+                        : CalculatorState{ static_cast<uint64_t>(digits[group][lane]), static_cast<int>(fractionDigits[group][lane]) };
+                    GameOutcome outcome = n.GetIntPart() < 10 ? GameOutcome::finished
+                        : overflow ? GameOutcome::overflow : GameOutcome::unknown;
+                    const int laneSteps = static_cast<int>(steps[group][lane]);
+                    GameResults terminal;
+                    if (outcome == GameOutcome::unknown && n.IsInteger() && n.digits < smallValueTableBound
+                        && LookupSmallValue(n.digits, &terminal)
+                        && (terminal.outcome == GameOutcome::finished || terminal.outcome == GameOutcome::overflow)
+                        && laneSteps + terminal.stepsCount < MaxMoves) {
+                        results[slots[group][lane]] = GameResults(startValues[slots[group][lane]], terminal.outcome,
+                            laneSteps + terminal.stepsCount, terminal.finalValue);
+                        load(group, lane);
+                        continue;
+                    }
+                    // loops and games out of moves are rare, the scalar Play measures them
+                    results[slots[group][lane]] = outcome == GameOutcome::unknown ? Play(startValues[slots[group][lane]])
+                        : GameResults(startValues[slots[group][lane]], outcome, laneSteps,
+                            outcome == GameOutcome::finished ? std::optional<CalculatorState>{ n } : std::nullopt);
+                    load(group, lane);
+                }
+                laneDigits[group] = _mm512_load_pd(digits[group]);
+                laneFractionDigits[group] = _mm512_load_si512(fractionDigits[group]);
+                laneSteps[group] = _mm512_load_si512(steps[group]);
+            }
+            tortoiseDigits[group] = _mm512_mask_mov_pd(tortoiseDigits[group], retired, laneDigits[group]);
+            tortoiseFractionDigits[group] = _mm512_mask_mov_epi64(tortoiseFractionDigits[group], retired, laneFractionDigits[group]);
+            power[group] = _mm512_mask_mov_epi64(power[group], retired, _mm512_set1_epi64(1));
+            lambda[group] = _mm512_mask_mov_epi64(lambda[group], retired, _mm512_setzero_si512());
+
+            __mmask8 jump = _mm512_cmpeq_epi64_mask(power[group], lambda[group]);
+            tortoiseDigits[group] = _mm512_mask_mov_pd(tortoiseDigits[group], jump, laneDigits[group]);
+            tortoiseFractionDigits[group] = _mm512_mask_mov_epi64(tortoiseFractionDigits[group], jump, laneFractionDigits[group]);
+            power[group] = _mm512_mask_slli_epi64(power[group], jump, power[group], 1);
+            lambda[group] = _mm512_mask_mov_epi64(lambda[group], jump, _mm512_setzero_si512());
+            anyActive |= active[group] != 0;
+        }
+        for (int group = 0; group < Groups; group++) {
+            lanes.Step(&laneDigits[group], &laneFractionDigits[group]);
+            laneSteps[group] = _mm512_add_epi64(laneSteps[group], _mm512_set1_epi64(1));
+            lambda[group] = _mm512_add_epi64(lambda[group], _mm512_set1_epi64(1));
+        }
+    }
+}
+#endif
+
+// Runs Play over startValues into results, on the widest kernel this CPU supports.
+void PlayBatch(const uint64_t* startValues, size_t count, GameResults* results) {
+#ifdef CALCGAME_AVX512_KERNEL
+    // the counters sit in the scalar step functions
+    static const bool useAvx512 = !InstrumentSteps && CpuSupportsAvx512();
+    if (useAvx512) {
+        PlayBatchAvx512(startValues, count, results);
+        return;
+    }
+#endif
+    PlayBatchScalar(startValues, count, results);
+}
+
+// Runs and an exact histogram of their step counts, which are bounded by the move cap.
+// The histogram covers MaxMoves up front and grows for rules with a higher cap.
+class OutcomeStats {
+public:
+    OutcomeStats() : totalRuns_(0), totalSteps_(0), stepsHistogram_(MaxMoves + 1) {}
+
+    void AddRun(uint64_t stepsCount) {
+        totalRuns_++;
+        totalSteps_ += stepsCount;
+        if (stepsCount >= stepsHistogram_.size()) {
+            stepsHistogram_.resize(stepsCount + 1);
+        }
+        stepsHistogram_[stepsCount]++;
+    }
+
+    void Merge(const OutcomeStats& other) {
+        totalRuns_ += other.totalRuns_;
+        totalSteps_ += other.totalSteps_;
+        if (other.stepsHistogram_.size() > stepsHistogram_.size()) {
+            stepsHistogram_.resize(other.stepsHistogram_.size());
+        }
+        for (size_t steps = 0; steps < other.stepsHistogram_.size(); steps++) {
+            stepsHistogram_[steps] += other.stepsHistogram_[steps];
+        }
+    }
+
+    uint64_t GetTotalRuns() const { return totalRuns_; }
+    double GetAvgStepsPerGame() const { return (1.0 * totalSteps_) / totalRuns_; }
+    uint64_t GetRunsWithSteps(size_t steps) const { return steps < stepsHistogram_.size() ? stepsHistogram_[steps] : 0; }
+    // The smallest step count that at least fraction of the runs did not exceed.
+    int GetStepsPercentile(double fraction) const {
+        uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(fraction * totalRuns_)));
+        uint64_t runs = 0;
+        for (size_t steps = 0; steps < stepsHistogram_.size(); steps++) {
+            runs += stepsHistogram_[steps];
+            if (runs >= rank) {
+                return static_cast<int>(steps);
+            }
+        }
+        return 0;
+    }
+    int GetMaxSteps() const { return GetStepsPercentile(1.0); }
+
+    void Serialize(std::ostream& out) const {
+        size_t usedBins = stepsHistogram_.size() - std::count(stepsHistogram_.begin(), stepsHistogram_.end(), 0);
+        out << totalRuns_ << ' ' << totalSteps_ << ' ' << usedBins;
+        for (size_t steps = 0; steps < stepsHistogram_.size(); steps++) {
+            if (stepsHistogram_[steps] != 0) {
+                out << ' ' << steps << ' ' << stepsHistogram_[steps];
+            }
+        }
+    }
+    bool Deserialize(std::istream& in) {
+        size_t usedBins;
+        if (!(in >> totalRuns_ >> totalSteps_ >> usedBins)) {
+            return false;
+        }
+        std::fill(stepsHistogram_.begin(), stepsHistogram_.end(), 0);
+        for (size_t i = 0; i < usedBins; i++) {
+            size_t steps;
+            if (!(in >> steps) || steps > UINT16_MAX) {
+                return false;
+            }
+            if (steps >= stepsHistogram_.size()) {
+                stepsHistogram_.resize(steps + 1);
+            }
+            if (!(in >> stepsHistogram_[steps])) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool operator==(const OutcomeStats& other) const {
+        if (totalRuns_ != other.totalRuns_ || totalSteps_ != other.totalSteps_) {
+            return false;
+        }
+        for (size_t steps = 0; steps < std::max(stepsHistogram_.size(), other.stepsHistogram_.size()); steps++) {
+            if (GetRunsWithSteps(steps) != other.GetRunsWithSteps(steps)) {
+                return false;
+            }
+        }
+        return true;
+    }
+private:
+    uint64_t totalRuns_;
+    uint64_t totalSteps_;
+    std::vector<uint64_t> stepsHistogram_;
+};
+
+// Merging is exact, so any split of a sweep between threads adds up to the single-threaded stats.
+class OverallStats {
+public:
+    OverallStats();
+    void AddRun(GameResults&& results);
+    void Merge(const OverallStats& other);
+    void Print() const;
+    void Serialize(std::ostream& out) const;
+    bool Deserialize(std::istream& in);
+    bool operator==(const OverallStats& other) const;
+
+    uint64_t GetTotalGames() const { return totalGames_; }
+    const OutcomeStats& GetOutcomeStats(GameOutcome outcome) const { return stats_[static_cast<size_t>(outcome)]; }
+    // Finished games by the int part of their final value.
+    uint64_t GetFinishedOn(int intPart) const { return finishedOn_[intPart]; }
+
+    static const std::string& ToString(GameOutcome outcome);
+private:
+    std::array<OutcomeStats, GameOutcomesCount> stats_;
+    std::array<uint64_t, 10> finishedOn_;
+    uint64_t totalGames_;
+};
+
+OverallStats::OverallStats() : finishedOn_(), totalGames_(0) {
+}
+
+void OverallStats::AddRun(GameResults&& results) {
+    stats_[static_cast<size_t>(results.outcome)].AddRun(results.stepsCount);
+    if (results.outcome == GameOutcome::finished) {
+        finishedOn_[results.finalValue->GetIntPart()]++;
+    }
+    totalGames_++;
+}
+
+void OverallStats::Merge(const OverallStats& other) {
+    for (size_t outcome = 0; outcome < stats_.size(); outcome++) {
+        stats_[outcome].Merge(other.stats_[outcome]);
+    }
+    for (size_t intPart = 0; intPart < finishedOn_.size(); intPart++) {
+        finishedOn_[intPart] += other.finishedOn_[intPart];
+    }
+    totalGames_ += other.totalGames_;
+}
+
+bool OverallStats::operator==(const OverallStats& other) const {
+    return totalGames_ == other.totalGames_ && stats_ == other.stats_ && finishedOn_ == other.finishedOn_;
+}
+
+void OverallStats::Serialize(std::ostream& out) const {
+    out << totalGames_ << ' ' << stats_.size();
+    for (size_t outcome = 0; outcome < stats_.size(); outcome++) {
+        out << ' ' << outcome << ' ';
+        stats_[outcome].Serialize(out);
+    }
+    out << ' ' << finishedOn_.size();
+    for (uint64_t count : finishedOn_) {
+        out << ' ' << count;
+    }
+}
+
+bool OverallStats::Deserialize(std::istream& in) {
+    size_t outcomesCount;
+    if (!(in >> totalGames_ >> outcomesCount) || outcomesCount > stats_.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < outcomesCount; i++) {
+        size_t outcome;
+        if (!(in >> outcome) || outcome >= stats_.size() || !stats_[outcome].Deserialize(in)) {
+            return false;
+        }
+    }
+    size_t intParts;
+    if (!(in >> intParts) || intParts != finishedOn_.size()) {
+        return false;
+    }
+    for (uint64_t& count : finishedOn_) {
+        in >> count;
+    }
+    return static_cast<bool>(in);
+}
+
+void OverallStats::Print() const {
+    for (const auto gameOutcome : AllGameOutcomes) {
+        const OutcomeStats& stats = GetOutcomeStats(gameOutcome);
+        if (stats.GetTotalRuns() == 0) {
+            continue;
+        }
+        std::cout << "Outcome " << ToString(gameOutcome)
+            << " occured " << 100.0 * stats.GetTotalRuns() / totalGames_ << "% of times"
+            << " and finished in " << stats.GetAvgStepsPerGame() << " of steps in average"
+            << " (p50 " << stats.GetStepsPercentile(0.5) << ", p99 " << stats.GetStepsPercentile(0.99)
+            << ", max " << stats.GetMaxSteps() << ")"
+            << std::endl;        
+    }
+    const uint64_t finishedGames = GetOutcomeStats(GameOutcome::finished).GetTotalRuns();
+    if (finishedGames != 0) {
+        std::cout << "Finished games ended on";
+        for (size_t intPart = 0; intPart < finishedOn_.size(); intPart++) {
+            std::cout << " " << intPart << ": " << 100.0 * finishedOn_[intPart] / finishedGames << "%";
+        }
+        std::cout << std::endl;
+    }
+}
+
+const std::string& OverallStats::ToString(GameOutcome outcome) {
+    static const std::string sFinished = "finished";
+    static const std::string sOverflow = "overflow";
+    static const std::string sTooManyMoves = "tooManyMoves";
+    static const std::string sCycle = "cycle";
+    switch (outcome) {
+        case GameOutcome::finished: return sFinished;
+        case GameOutcome::overflow: return sOverflow;
+        case GameOutcome::tooManyMoves: return sTooManyMoves;
+        case GameOutcome::cycle: return sCycle;
+        default: throw "Unhandled GameOutcome";
+    }
+}
+
+// results file ///////////////////////////////////////////////////////////////////////////////////
+
+// Positioned writes, so that workers can fill their own blocks of one file concurrently.
+class PositionedFile {
+public:
+    PositionedFile() = default;
+    PositionedFile(const PositionedFile&) = delete;
+    PositionedFile& operator=(const PositionedFile&) = delete;
+    ~PositionedFile() { Close(); }
+    bool Create(const std::string& path);
+    bool WriteAt(const void* data, size_t size, uint64_t offset);
+    void Close();
+private:
+#ifdef _WIN32
+    HANDLE handle_ = INVALID_HANDLE_VALUE;
+#else
+    int fd_ = -1;
+#endif
+};
+
+// A read-only view of a whole file.
+class MappedFile {
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() { Close(); }
+    bool Open(const std::string& path);
+    void Close();
+    const uint8_t* GetData() const { return data_; }
+    uint64_t GetSize() const { return size_; }
+private:
+    const uint8_t* data_ = nullptr;
+    uint64_t size_ = 0;
+#ifdef _WIN32
+    HANDLE mapping_ = nullptr;
+#endif
+};
+
+#ifdef _WIN32
+bool PositionedFile::Create(const std::string& path) {
+    handle_ = CreateFileA(path.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    return handle_ != INVALID_HANDLE_VALUE;
+}
+
+bool PositionedFile::WriteAt(const void* data, size_t size, uint64_t offset) {
+    const char* bytes = static_cast<const char*>(data);
+    while (size > 0) {
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = static_cast<DWORD>(offset);
+        overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+        DWORD written = 0;
+        if (!WriteFile(handle_, bytes, static_cast<DWORD>(std::min<size_t>(size, 1 << 30)), &written, &overlapped) || written == 0) {
+            return false;
+        }
+        bytes += written;
+        size -= written;
+        offset += written;
+    }
+    return true;
+}
+
+void PositionedFile::Close() {
+    if (handle_ != INVALID_HANDLE_VALUE) {
+        CloseHandle(handle_);
+        handle_ = INVALID_HANDLE_VALUE;
+    }
+}
+
+bool MappedFile::Open(const std::string& path) {
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        CloseHandle(file);
+        return false;
+    }
+    mapping_ = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (mapping_ == nullptr) {
+        return false;
+    }
+    data_ = static_cast<const uint8_t*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+    if (data_ == nullptr) {
+        Close();
+        return false;
+    }
+    size_ = static_cast<uint64_t>(size.QuadPart);
+    return true;
+}
+
+void MappedFile::Close() {
+    if (data_ != nullptr) {
+        UnmapViewOfFile(data_);
+    }
+    if (mapping_ != nullptr) {
+        CloseHandle(mapping_);
+    }
+    data_ = nullptr;
+    mapping_ = nullptr;
+    size_ = 0;
+}
+#else
+bool PositionedFile::Create(const std::string& path) {
+    fd_ = open(path.c_str(), O_CREAT | O_TRUNC | O_WRONLY, 0644);
+    return fd_ >= 0;
+}
+
+bool PositionedFile::WriteAt(const void* data, size_t size, uint64_t offset) {
+    const char* bytes = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t written = pwrite(fd_, bytes, size, static_cast<off_t>(offset));
+        if (written <= 0) {
+            return false;
+        }
+        bytes += written;
+        size -= written;
+        offset += written;
+    }
+    return true;
+}
+
+void PositionedFile::Close() {
+    if (fd_ >= 0) {
+        close(fd_);
+        fd_ = -1;
+    }
+}
+
+bool MappedFile::Open(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat status;
+    if (fstat(fd, &status) != 0 || status.st_size == 0) {
+        close(fd);
+        return false;
+    }
+    void* data = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+    data_ = static_cast<const uint8_t*>(data);
+    size_ = static_cast<uint64_t>(status.st_size);
+    return true;
+}
+
+void MappedFile::Close() {
+    if (data_ != nullptr) {
+        munmap(const_cast<uint8_t*>(data_), static_cast<size_t>(size_));
+    }
+    data_ = nullptr;
+    size_ = 0;
+}
+#endif
+
+// File layout: the header, one uint64 file offset per block (0 until the block is written), then the blocks
+// in the order they completed. A block covers blockSize consecutive start values with the columns
+//   uint8 outcome[blockSize], uint16 steps[blockSize], uint16 recordRank[blockSize / 64], uint64 record[],
+// where only games with a final value (finished, cycle) have a 10-byte record, and recordRank counts the
+// records before each run of 64 games. A record is a uint64 digits << 4 | fractionDigits followed by
+// the uint16 cycle length. Multi-byte values are in host byte order.
+struct ResultsFileHeader {
+    // recordRank is a uint16, so a block can hold at most this many games
+    static constexpr uint32_t MaxBlockSize = 1 << 16;
+
+    char magic[8] = { 'C', 'A', 'L', 'C', 'R', 'E', 'S', '\0' };
+    uint32_t version = 2;
+    uint32_t blockSize = 0;
+    uint64_t lo = 0;
+    uint64_t hi = 0;
+    uint32_t digitsInCalculator = DigitsInCalculator;
+    uint32_t maxMoves = MaxMoves;
+    uint32_t twoRepeatingDigitsRule = ImplementTwoRepeatingDigitsRule;
+    uint32_t reserved[5] = {};
+
+    uint64_t GetBlockCount() const { return (hi - lo) / blockSize + 1; }
+    uint64_t GetBlockTableOffset() const { return sizeof(ResultsFileHeader); }
+    uint64_t GetRecordsOffset() const { return (3ull * blockSize + blockSize / 32 + 7) / 8 * 8; }
+    RulesVariant GetRules() const {
+        return RulesVariant{ static_cast<int>(digitsInCalculator), twoRepeatingDigitsRule != 0, static_cast<int>(maxMoves) };
+    }
+    bool HasCurrentRules() const { return GetRules() == RulesVariant(); }
+};
+static_assert(sizeof(ResultsFileHeader) == 64, "the header is part of the file format");
+
+constexpr uint64_t ResultsRecordSize = sizeof(uint64_t) + sizeof(uint16_t);
+
+bool HasResultsRecord(GameOutcome outcome) {
+    return outcome == GameOutcome::finished || outcome == GameOutcome::cycle;
+}
+
+class ResultsFileWriter {
+public:
+    static constexpr uint32_t DefaultBlockSize = 1 << 14;
+
+    bool Create(const std::string& path, uint64_t lo, uint64_t hi, uint32_t blockSize = DefaultBlockSize,
+        const RulesVariant& rules = RulesVariant());
+    // Thread safe, each block is written once with the results of its start values in order.
+    bool WriteBlock(uint64_t block, const GameResults* results, size_t count);
+    bool Close();
+
+    const ResultsFileHeader& GetHeader() const { return header_; }
+private:
+    PositionedFile file_;
+    ResultsFileHeader header_;
+    std::atomic<uint64_t> nextOffset_{ 0 };
+    std::atomic<bool> failed_{ false };
+};
+
+bool ResultsFileWriter::Create(const std::string& path, uint64_t lo, uint64_t hi, uint32_t blockSize, const RulesVariant& rules) {
+    if (lo > hi || blockSize == 0 || blockSize % 64 != 0 || blockSize > ResultsFileHeader::MaxBlockSize
+        || rules.maxMoves > UINT16_MAX || !file_.Create(path)) {
+        return false;
+    }
+    header_.blockSize = blockSize;
+    header_.lo = lo;
+    header_.hi = hi;
+    header_.digitsInCalculator = rules.digits;
+    header_.maxMoves = rules.maxMoves;
+    header_.twoRepeatingDigitsRule = rules.twoRepeatingDigitsRule;
+    failed_ = !file_.WriteAt(&header_, sizeof(header_), 0);
+    const std::vector<uint64_t> zeros(1 << 16);
+    const uint64_t blockCount = header_.GetBlockCount();
+    for (uint64_t block = 0; block < blockCount && !failed_; block += zeros.size()) {
+        size_t count = static_cast<size_t>(std::min<uint64_t>(zeros.size(), blockCount - block));
+        failed_ = !file_.WriteAt(zeros.data(), count * sizeof(uint64_t), header_.GetBlockTableOffset() + block * sizeof(uint64_t));
+    }
+    nextOffset_ = (header_.GetBlockTableOffset() + blockCount * sizeof(uint64_t) + 63) / 64 * 64;
+    return !failed_;
+}
+
+bool ResultsFileWriter::WriteBlock(uint64_t block, const GameResults* results, size_t count) {
+    const uint32_t blockSize = header_.blockSize;
+    const uint64_t recordsOffset = header_.GetRecordsOffset();
+    size_t recordCount = 0;
+    for (size_t i = 0; i < count; i++) {
+        recordCount += HasResultsRecord(results[i].outcome);
+    }
+    std::vector<uint8_t> buffer(recordsOffset + recordCount * ResultsRecordSize);
+    uint16_t rank = 0;
+    for (size_t i = 0; i < count; i++) {
+        const GameResults& game = results[i];
+        if (i % 64 == 0) {
+            memcpy(&buffer[3ull * blockSize + i / 64 * sizeof(uint16_t)], &rank, sizeof(rank));
+        }
+        uint16_t steps = static_cast<uint16_t>(game.stepsCount);
+        buffer[i] = static_cast<uint8_t>(game.outcome);
+        memcpy(&buffer[blockSize + i * sizeof(uint16_t)], &steps, sizeof(steps));
+        if (HasResultsRecord(game.outcome)) {
+            uint64_t finalValue = game.finalValue->digits << 4 | static_cast<uint64_t>(game.finalValue->fractionDigits);
+            uint16_t cycleLength = static_cast<uint16_t>(game.cycleLength);
+            memcpy(&buffer[recordsOffset + rank * ResultsRecordSize], &finalValue, sizeof(finalValue));
+            memcpy(&buffer[recordsOffset + rank * ResultsRecordSize + sizeof(finalValue)], &cycleLength, sizeof(cycleLength));
+            rank++;
+        }
+    }
+    uint64_t offset = nextOffset_.fetch_add((buffer.size() + 63) / 64 * 64);
+    if (!file_.WriteAt(buffer.data(), buffer.size(), offset)
+        || !file_.WriteAt(&offset, sizeof(offset), header_.GetBlockTableOffset() + block * sizeof(uint64_t))) {
+        failed_ = true;
+    }
+    return !failed_;
+}
+
+bool ResultsFileWriter::Close() {
+    file_.Close();
+    return !failed_;
+}
+
+// Looks up stored games by start value straight from the mapped file.
+class ResultsFileReader {
+public:
+    bool Open(const std::string& path);
+    // False for start values outside the file and for blocks that were never written.
+    bool Lookup(uint64_t startValue, GameResults* results) const;
+
+    const ResultsFileHeader& GetHeader() const { return header_; }
+private:
+    MappedFile file_;
+    ResultsFileHeader header_;
+};
+
+bool ResultsFileReader::Open(const std::string& path) {
+    if (!file_.Open(path) || file_.GetSize() < sizeof(header_)) {
+        return false;
+    }
+    memcpy(&header_, file_.GetData(), sizeof(header_));
+    const ResultsFileHeader expected;
+    return memcmp(header_.magic, expected.magic, sizeof(expected.magic)) == 0 && header_.version == expected.version
+        && header_.blockSize != 0 && header_.blockSize % 64 == 0 && header_.blockSize <= ResultsFileHeader::MaxBlockSize
+        && header_.lo <= header_.hi
+        && file_.GetSize() >= header_.GetBlockTableOffset() + header_.GetBlockCount() * sizeof(uint64_t);
+}
+
+bool ResultsFileReader::Lookup(uint64_t startValue, GameResults* results) const {
+    if (startValue < header_.lo || startValue > header_.hi) {
+        return false;
+    }
+    const uint8_t* data = file_.GetData();
+    const uint64_t index = startValue - header_.lo;
+    const uint64_t i = index % header_.blockSize;
+    uint64_t offset;
+    memcpy(&offset, data + header_.GetBlockTableOffset() + index / header_.blockSize * sizeof(uint64_t), sizeof(offset));
+    const uint64_t recordsOffset = header_.GetRecordsOffset();
+    if (offset == 0 || offset + recordsOffset > file_.GetSize()) {
+        return false;
+    }
+    const uint8_t* block = data + offset;
+    uint16_t steps;
+    memcpy(&steps, block + header_.blockSize + i * sizeof(uint16_t), sizeof(steps));
+    *results = GameResults(startValue, static_cast<GameOutcome>(block[i]), steps, std::nullopt);
+    if (HasResultsRecord(results->outcome)) {
+        uint16_t rank;
+        memcpy(&rank, block + 3ull * header_.blockSize + i / 64 * sizeof(uint16_t), sizeof(rank));
+        for (uint64_t j = i / 64 * 64; j < i; j++) {
+            rank += HasResultsRecord(static_cast<GameOutcome>(block[j]));
+        }
+        uint64_t finalValue;
+        uint16_t cycleLength;
+        if (offset + recordsOffset + (rank + 1) * ResultsRecordSize > file_.GetSize()) {
+            return false;
+        }
+        memcpy(&finalValue, block + recordsOffset + rank * ResultsRecordSize, sizeof(finalValue));
+        memcpy(&cycleLength, block + recordsOffset + rank * ResultsRecordSize + sizeof(finalValue), sizeof(cycleLength));
+        results->finalValue = CalculatorState{ finalValue >> 4, static_cast<int>(finalValue & 0xF) };
+        if (results->outcome == GameOutcome::cycle) {
+            results->cycleLength = cycleLength;
+            results->cycleEntryStep = results->stepsCount - results->cycleLength;
+        }
+    }
+    return true;
+}
+
+// sweep engine ///////////////////////////////////////////////////////////////////////////////////
+
+unsigned DefaultThreadCount(unsigned requested) {
+    return requested != 0 ? requested : std::max(1u, std::thread::hardware_concurrency());
+}
+
+// Each worker owns a contiguous range of task indices and consumes it from the front.
+// An idle worker steals the upper half of another worker's remaining range.
+class WorkStealingPool {
+public:
+    explicit WorkStealingPool(unsigned threadCount = 0);
+    unsigned GetThreadCount() const { return threadCount_; }
+    void Run(uint64_t taskCount, const std::function<void(unsigned, uint64_t)>& task);
+private:
+    struct alignas(64) TaskRange {
+        std::mutex mutex;
+        uint64_t begin = 0;
+        uint64_t end = 0;
+    };
+    bool PopOwn(unsigned worker, uint64_t* taskIndex);
+    bool Steal(unsigned thief, uint64_t* taskIndex);
+    void WorkerLoop(unsigned worker, const std::function<void(unsigned, uint64_t)>& task);
+private:
+    unsigned threadCount_;
+    std::unique_ptr<TaskRange[]> ranges_;
+};
+
+WorkStealingPool::WorkStealingPool(unsigned threadCount) : threadCount_(DefaultThreadCount(threadCount)) {
+    ranges_.reset(new TaskRange[threadCount_]);
+}
+
+void WorkStealingPool::Run(uint64_t taskCount, const std::function<void(unsigned, uint64_t)>& task) {
+    for (unsigned worker = 0; worker < threadCount_; worker++) {
+        ranges_[worker].begin = taskCount * worker / threadCount_;
+        ranges_[worker].end = taskCount * (worker + 1) / threadCount_;
+    }
+    std::vector<std::thread> threads;
+    for (unsigned worker = 1; worker < threadCount_; worker++) {
+        threads.emplace_back([this, worker, &task]() { WorkerLoop(worker, task); });
+    }
+    WorkerLoop(0, task);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+bool WorkStealingPool::PopOwn(unsigned worker, uint64_t* taskIndex) {
+    TaskRange& range = ranges_[worker];
+    std::lock_guard<std::mutex> lock(range.mutex);
+    if (range.begin == range.end) {
+        return false;
+    }
+    *taskIndex = range.begin++;
+    return true;
+}
+
+bool WorkStealingPool::Steal(unsigned thief, uint64_t* taskIndex) {
+    for (unsigned i = 1; i < threadCount_; i++) {
+        TaskRange& victim = ranges_[(thief + i) % threadCount_];
+        uint64_t stolenBegin;
+        uint64_t stolenEnd;
+        {
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (victim.begin == victim.end) {
+                continue;
+            }
+            stolenBegin = victim.begin + (victim.end - victim.begin) / 2;
+            stolenEnd = victim.end;
+            victim.end = stolenBegin;
+        }
+        TaskRange& own = ranges_[thief];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        own.begin = stolenBegin + 1;
+        own.end = stolenEnd;
+        *taskIndex = stolenBegin;
+        return true;
+    }
+    return false;
+}
+
+void WorkStealingPool::WorkerLoop(unsigned worker, const std::function<void(unsigned, uint64_t)>& task) {
+    uint64_t taskIndex;
+    while (PopOwn(worker, &taskIndex) || Steal(worker, &taskIndex)) {
+        task(worker, taskIndex);
+    }
+}
+
+struct SweepOptions {
+    unsigned threadCount = 0;
+    uint64_t chunkSize = 1 << 14;
+    TrajectoryCache* cache = nullptr;
+    // when set, every game is also stored; the sweep then runs in the file's blocks and lo must start one
+    ResultsFileWriter* resultsWriter = nullptr;
+    RulesVariant rules;
+};
+
+// Visits [lo, hi] in chunks of options.chunkSize; visit(worker, chunkLo, chunkHi) gets inclusive bounds.
+void SweepChunks(uint64_t lo, uint64_t hi, const SweepOptions& options,
+    const std::function<void(unsigned, uint64_t, uint64_t)>& visit, WorkStealingPool& pool) {
+    if (lo > hi) {
+        return;
+    }
+    const uint64_t chunkSize = std::max<uint64_t>(1, options.chunkSize);
+    const uint64_t chunkCount = (hi - lo) / chunkSize + 1;
+    pool.Run(chunkCount, [&](unsigned worker, uint64_t chunk) {
+        uint64_t chunkLo = lo + chunk * chunkSize;
+        uint64_t chunkHi = std::min(hi, chunkLo + (chunkSize - 1));
+        visit(worker, chunkLo, chunkHi);
+    });
+}
+
+// Plays [chunkLo, chunkHi] the way options ask for and stores the chunk when there is a results file.
+void PlaySweepChunk(uint64_t chunkLo, uint64_t chunkHi, const SweepOptions& options, std::vector<GameResults>* results) {
+    results->resize(chunkHi - chunkLo + 1);
+    if (options.rules != RulesVariant()) {
+        // the batch kernel only knows the default rules
+        bool supported = VisitRules(options.rules, [&](auto rules) {
+            for (uint64_t n = chunkLo; n <= chunkHi; n++) {
+                (*results)[n - chunkLo] = Play<decltype(rules)>(n, options.cache);
+            }
+        });
+        if (!supported) {
+            throw "Unsupported rules variant";
+        }
+    } else if (options.cache != nullptr) {
+        for (uint64_t n = chunkLo; n <= chunkHi; n++) {
+            (*results)[n - chunkLo] = Play(n, options.cache);
+        }
+    } else {
+        std::vector<uint64_t> startValues(results->size());
+        std::iota(startValues.begin(), startValues.end(), chunkLo);
+        PlayBatch(startValues.data(), startValues.size(), results->data());
+    }
+    if (options.resultsWriter != nullptr) {
+        const ResultsFileHeader& header = options.resultsWriter->GetHeader();
+        options.resultsWriter->WriteBlock((chunkLo - header.lo) / header.blockSize, results->data(), results->size());
+    }
+}
+
+// The options a sweep of [lo, hi] runs its chunks with: the results file's blocks when there is one.
+SweepOptions GetChunkOptions(uint64_t lo, uint64_t hi, const SweepOptions& options) {
+    SweepOptions chunkOptions = options;
+    if (options.resultsWriter != nullptr) {
+        const ResultsFileHeader& header = options.resultsWriter->GetHeader();
+        if (lo < header.lo || hi > header.hi || (lo - header.lo) % header.blockSize != 0 || header.GetRules() != options.rules) {
+            throw "Sweep range or rules do not match the results file";
+        }
+        chunkOptions.chunkSize = header.blockSize;
+    }
+    chunkOptions.chunkSize = std::max<uint64_t>(1, chunkOptions.chunkSize);
+    return chunkOptions;
+}
+
+OverallStats SweepStats(uint64_t lo, uint64_t hi, const SweepOptions& options = SweepOptions()) {
+    struct alignas(64) PaddedStats {
+        OverallStats stats;
+    };
+    const SweepOptions chunkOptions = GetChunkOptions(lo, hi, options);
+    WorkStealingPool pool(options.threadCount);
+    std::vector<PaddedStats> perThreadStats(pool.GetThreadCount());
+    SweepChunks(lo, hi, chunkOptions, [&](unsigned worker, uint64_t chunkLo, uint64_t chunkHi) {
+        OverallStats& stats = perThreadStats[worker].stats;
+        std::vector<GameResults> results;
+        PlaySweepChunk(chunkLo, chunkHi, options, &results);
+        for (GameResults& gameResults : results) {
+            stats.AddRun(std::move(gameResults));
+        }
+    }, pool);
+
+    OverallStats stats;
+    for (const auto& threadStats : perThreadStats) {
+        stats.Merge(threadStats.stats);
+    }
+    return stats;
+}
+
+// small value table //////////////////////////////////////////////////////////////////////////////
+
+// The table Play and the batch kernel finish games in is a results file of [0, bound) under the default rules.
+// It is mapped, so a game only pages in the blocks it looks up and loading it costs nothing up front.
+std::unique_ptr<ResultsFileReader> SmallValueTable;
+
+bool LookupSmallValue(uint64_t state, GameResults* results) {
+    return SmallValueTable->Lookup(state, results);
+}
+
+// Sweeps [0, bound) in parallel into a table file.
+bool BuildSmallValueTable(const std::string& path, uint64_t bound, unsigned threadCount = 0) {
+    ResultsFileWriter writer;
+    if (bound == 0 || !writer.Create(path, 0, bound - 1)) {
+        return false;
+    }
+    SweepOptions options;
+    options.threadCount = threadCount;
+    options.resultsWriter = &writer;
+    SweepStats(0, bound - 1, options);
+    return writer.Close();
+}
+
+// Maps the table for Play to finish games in, an empty path unloads it. Not thread safe, load before playing.
+bool LoadSmallValueTable(const std::string& path) {
+    SmallValueTableBound = 0;
+    SmallValueTable.reset();
+    if (path.empty()) {
+        return true;
+    }
+    std::unique_ptr<ResultsFileReader> table(new ResultsFileReader());
+    if (!table->Open(path) || !table->GetHeader().HasCurrentRules() || table->GetHeader().lo != 0) {
+        return false;
+    }
+    const uint64_t bound = table->GetHeader().hi + 1;
+    SmallValueTable = std::move(table);
+    SmallValueTableBound = bound;
+    return true;
+}
+
+// pipelined sweep ////////////////////////////////////////////////////////////////////////////////
+
+// Waits a little longer on each call: spins first, then yields, then sleeps, so that a stage waiting on a
+// queue does not take the core from the stage it waits for.
+void QueueBackoff(unsigned* attempt) {
+    if (*attempt >= 64) {
+        std::this_thread::sleep_for(std::chrono::microseconds(*attempt >= 128 ? 100 : 10));
+    } else if (*attempt >= 16) {
+        std::this_thread::yield();
+    }
+    (*attempt)++;
+}
+
+// Bounded multi-producer multi-consumer ring. Each cell's sequence number says whether it is free for the
+// producer of a position or holds the value for its consumer, so pushes and pops only race on one atomic each.
+template <typename T>
+class BoundedMpmcQueue {
+public:
+    // capacity is rounded up to a power of 2
+    explicit BoundedMpmcQueue(size_t capacity);
+    bool TryPush(T&& value);
+    bool TryPop(T* value);
+    // these wait while the queue is full or empty
+    void Push(T&& value);
+    void Pop(T* value);
+private:
+    struct alignas(64) Cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+    std::unique_ptr<Cell[]> cells_;
+    size_t mask_;
+    alignas(64) std::atomic<size_t> pushPosition_;
+    alignas(64) std::atomic<size_t> popPosition_;
+};
+
+template <typename T>
+BoundedMpmcQueue<T>::BoundedMpmcQueue(size_t capacity) : pushPosition_(0), popPosition_(0) {
+    size_t size = 2;
+    while (size < capacity) {
+        size *= 2;
+    }
+    cells_.reset(new Cell[size]);
+    for (size_t position = 0; position < size; position++) {
+        cells_[position].sequence.store(position, std::memory_order_relaxed);
+    }
+    mask_ = size - 1;
+}
+
+template <typename T>
+bool BoundedMpmcQueue<T>::TryPush(T&& value) {
+    size_t position = pushPosition_.load(std::memory_order_relaxed);
+    for (;;) {
+        Cell& cell = cells_[position & mask_];
+        const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        if (sequence == position) {
+            if (pushPosition_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                cell.value = std::move(value);
+                cell.sequence.store(position + 1, std::memory_order_release);
+                return true;
+            }
+        } else if (static_cast<std::ptrdiff_t>(sequence - position) < 0) {
+            return false;
+        } else {
+            position = pushPosition_.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+template <typename T>
+bool BoundedMpmcQueue<T>::TryPop(T* value) {
+    size_t position = popPosition_.load(std::memory_order_relaxed);
+    for (;;) {
+        Cell& cell = cells_[position & mask_];
+        const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        if (sequence == position + 1) {
+            if (popPosition_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                *value = std::move(cell.value);
+                cell.sequence.store(position + mask_ + 1, std::memory_order_release);
+                return true;
+            }
+        } else if (static_cast<std::ptrdiff_t>(sequence - (position + 1)) < 0) {
+            return false;
+        } else {
+            position = popPosition_.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+template <typename T>
+void BoundedMpmcQueue<T>::Push(T&& value) {
+    for (unsigned attempt = 0; !TryPush(std::move(value)); ) {
+        QueueBackoff(&attempt);
+    }
+}
+
+template <typename T>
+void BoundedMpmcQueue<T>::Pop(T* value) {
+    for (unsigned attempt = 0; !TryPop(value); ) {
+        QueueBackoff(&attempt);
+    }
+}
+
+struct PipelineProgress {
+    uint64_t gamesDone = 0;
+    uint64_t totalGames = 0;
+    double elapsedSeconds = 0;
+    // since the previous report, to show a drop as it happens
+    double gamesPerSecond = 0;
+    const OverallStats* stats = nullptr;
+};
+
+void PrintPipelineProgress(const PipelineProgress& progress) {
+    const double averageRate = progress.elapsedSeconds > 0 ? progress.gamesDone / progress.elapsedSeconds : 0;
+    const uint64_t etaSeconds = averageRate > 0 ? static_cast<uint64_t>((progress.totalGames - progress.gamesDone) / averageRate) : 0;
+    std::cerr << "Swept " << 100.0 * progress.gamesDone / progress.totalGames << "% " << progress.gamesDone
+        << " games, " << static_cast<uint64_t>(progress.gamesPerSecond) << " games/s (average "
+        << static_cast<uint64_t>(averageRate) << "), ETA " << etaSeconds / 3600 << "h" << etaSeconds / 60 % 60
+        << "m" << etaSeconds % 60 << "s,";
+    for (const auto gameOutcome : AllGameOutcomes) {
+        std::cerr << " " << OverallStats::ToString(gameOutcome) << " "
+            << 100.0 * progress.stats->GetOutcomeStats(gameOutcome).GetTotalRuns() / std::max<uint64_t>(1, progress.gamesDone) << "%";
+    }
+    std::cerr << std::endl;
+}
+
+struct PipelineOptions {
+    // bound on the batches waiting between two stages, 0 for 2 per worker; in flight memory stays under
+    // about twice this many batches
+    size_t queueBatches = 0;
+    // 0 for no progress reports; the last report comes when the sweep is done
+    double progressSeconds = 0;
+    std::function<void(const PipelineProgress&)> report = PrintPipelineProgress;
+};
+
+// Sweeps [lo, hi] in three stages: this thread produces the chunks of options.chunkSize, options.threadCount
+// workers play them, and an aggregator thread owns the stats and the progress reports. The stages only meet
+// on bounded queues, so a slow aggregator holds the producer back instead of growing memory.
+OverallStats SweepPipelined(uint64_t lo, uint64_t hi, const SweepOptions& options,
+    const PipelineOptions& pipeline = PipelineOptions()) {
+    OverallStats stats;
+    if (lo > hi) {
+        return stats;
+    }
+    const SweepOptions chunkOptions = GetChunkOptions(lo, hi, options);
+    const unsigned workerCount = DefaultThreadCount(options.threadCount);
+    const size_t queueBatches = pipeline.queueBatches != 0 ? pipeline.queueBatches : 2 * workerCount;
+    const uint64_t chunkSize = chunkOptions.chunkSize;
+    const uint64_t chunkCount = (hi - lo) / chunkSize + 1;
+
+    // an empty range tells a worker to stop
+    BoundedMpmcQueue<std::pair<uint64_t, uint64_t>> chunks(queueBatches);
+    BoundedMpmcQueue<std::vector<GameResults>> played(queueBatches);
+    BoundedMpmcQueue<std::vector<GameResults>> freeBuffers(queueBatches + workerCount + 1);
+
+    std::vector<std::thread> workers;
+    for (unsigned worker = 0; worker < workerCount; worker++) {
+        workers.emplace_back([&]() {
+            for (;;) {
+                std::pair<uint64_t, uint64_t> chunk;
+                chunks.Pop(&chunk);
+                if (chunk.first > chunk.second) {
+                    return;
+                }
+                std::vector<GameResults> results;
+                freeBuffers.TryPop(&results);
+                PlaySweepChunk(chunk.first, chunk.second, options, &results);
+                played.Push(std::move(results));
+            }
+        });
+    }
+    std::thread aggregator([&]() {
+        using Clock = std::chrono::steady_clock;
+        const Clock::time_point start = Clock::now();
+        Clock::time_point lastReport = start;
+        uint64_t lastReportGames = 0;
+        auto report = [&](Clock::time_point now) {
+            PipelineProgress progress;
+            progress.gamesDone = stats.GetTotalGames();
+            progress.totalGames = hi - lo + 1;
+            progress.elapsedSeconds = std::chrono::duration<double>(now - start).count();
+            const double interval = std::chrono::duration<double>(now - lastReport).count();
+            progress.gamesPerSecond = interval > 0 ? (progress.gamesDone - lastReportGames) / interval : 0;
+            progress.stats = &stats;
+            pipeline.report(progress);
+            lastReport = now;
+            lastReportGames = progress.gamesDone;
+        };
+        for (uint64_t chunk = 0; chunk < chunkCount; chunk++) {
+            std::vector<GameResults> results;
+            played.Pop(&results);
+            for (GameResults& gameResults : results) {
+                stats.AddRun(std::move(gameResults));
+            }
+            results.clear();
+            freeBuffers.TryPush(std::move(results));
+            if (pipeline.progressSeconds > 0) {
+                const Clock::time_point now = Clock::now();
+                if (chunk + 1 == chunkCount || std::chrono::duration<double>(now - lastReport).count() >= pipeline.progressSeconds) {
+                    report(now);
+                }
+            }
+        }
+    });
+
+    for (uint64_t chunk = 0; chunk < chunkCount; chunk++) {
+        const uint64_t chunkLo = lo + chunk * chunkSize;
+        chunks.Push(std::make_pair(chunkLo, std::min(hi, chunkLo + (chunkSize - 1))));
+    }
+    for (unsigned worker = 0; worker < workerCount; worker++) {
+        chunks.Push(std::make_pair<uint64_t, uint64_t>(1, 0));
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    aggregator.join();
+    return stats;
+}
+
+// stratified sampling ////////////////////////////////////////////////////////////////////////////
+
+struct SamplingOptions {
+    unsigned threadCount = 0;
+    uint64_t seed = 1;
+    // the range is split by digit count and by this many leading digits
+    int leadingDigits = 2;
+    // stops once every outcome's share is known to within this many percentage points with 95% confidence,
+    // once the time budget or maxGames is spent, or once every stratum has been played through
+    double precisionPercent = 0.01;
+    double timeBudgetSeconds = 10;
+    uint64_t maxGames = UINT64_MAX;
+    uint64_t roundGames = 1 << 16;
+    // a stratum gets at least this many games a round; one no larger is played through in the first round
+    uint64_t minStratumGames = 16;
+    RulesVariant rules;
+};
+
+// a 95% confidence interval, value +- halfWidth
+struct SampleEstimate {
+    double value = 0;
+    double halfWidth = 0;
+};
+
+struct SampledStats {
+    uint64_t gamesPlayed = 0;
+    size_t strataCount = 0;
+    unsigned rounds = 0;
+    double elapsedSeconds = 0;
+    // every stratum was played through, so the estimates are exact
+    bool exhaustive = false;
+    // in percent of the games
+    std::array<SampleEstimate, GameOutcomesCount> outcomeShare;
+    // of the games with the outcome
+    std::array<SampleEstimate, GameOutcomesCount> avgSteps;
+
+    void Print() const;
+};
+
+void SampledStats::Print() const {
+    std::cout << "Sampled " << gamesPlayed << " games from " << strataCount << " strata in " << rounds
+        << " rounds, " << elapsedSeconds << " s" << (exhaustive ? ", every value played" : "") << std::endl;
+    for (const auto gameOutcome : AllGameOutcomes) {
+        const SampleEstimate& share = outcomeShare[static_cast<size_t>(gameOutcome)];
+        const SampleEstimate& steps = avgSteps[static_cast<size_t>(gameOutcome)];
+        if (share.value == 0) {
+            continue;
+        }
+        std::cout << "Outcome " << OverallStats::ToString(gameOutcome)
+            << " occured " << share.value << "% +- " << share.halfWidth << "% of times"
+            << " and finished in " << steps.value << " +- " << steps.halfWidth << " of steps in average" << std::endl;
+    }
+}
+
+// Each stratum keeps its own generator, seeded from the options' seed and its index, so the samples do not
+// depend on the thread count and a run with the same options draws the same games.
+struct SamplingStratum {
+    uint64_t lo;
+    uint64_t hi;
+    double weight;
+    std::mt19937_64 random;
+    bool playedThrough = false;
+    uint64_t games = 0;
+    std::array<uint64_t, GameOutcomesCount> outcomeGames{};
+    std::array<double, GameOutcomesCount> stepsSum{};
+    std::array<double, GameOutcomesCount> stepsSquaresSum{};
+
+    void AddRun(const GameResults& results) {
+        const size_t outcome = static_cast<size_t>(results.outcome);
+        games++;
+        outcomeGames[outcome]++;
+        stepsSum[outcome] += results.stepsCount;
+        stepsSquaresSum[outcome] += static_cast<double>(results.stepsCount) * results.stepsCount;
+    }
+};
+
+// Splits [lo, hi] by digit count and the leading digits of the start values.
+std::vector<SamplingStratum> MakeSamplingStrata(uint64_t lo, uint64_t hi, const SamplingOptions& options) {
+    std::vector<SamplingStratum> strata;
+    for (int digits = 1; digits <= 19 && lo <= hi; digits++) {
+        const uint64_t digitsLo = digits == 1 ? 0 : PowersOfTen[digits - 1];
+        const uint64_t digitsHi = PowersOfTen[digits] - 1;
+        if (digitsHi < lo || digitsLo > hi) {
+            continue;
+        }
+        const int leading = std::min(digits, std::max(1, options.leadingDigits));
+        const uint64_t stratumSize = PowersOfTen[digits - leading];
+        const uint64_t first = std::max(lo, digitsLo);
+        const uint64_t last = std::min(hi, digitsHi);
+        for (uint64_t stratumLo = first; stratumLo <= last; ) {
+            const uint64_t stratumHi = std::min(last, stratumLo - stratumLo % stratumSize + stratumSize - 1);
+            SamplingStratum stratum;
+            stratum.lo = stratumLo;
+            stratum.hi = stratumHi;
+            stratum.weight = static_cast<double>(stratumHi - stratumLo + 1) / static_cast<double>(hi - lo + 1);
+            stratum.random.seed(options.seed * 0x9E3779B97F4A7C15ull + strata.size());
+            strata.push_back(std::move(stratum));
+            if (stratumHi == UINT64_MAX) {
+                break;
+            }
+            stratumLo = stratumHi + 1;
+        }
+    }
+    return strata;
+}
+
+// The stratified estimate of each outcome's share and, as a ratio estimate, of its average steps.
+void EstimateSampledStats(const std::vector<SamplingStratum>& strata, SampledStats* sampled) {
+    constexpr double Z95 = 1.959964;
+    for (size_t outcome = 0; outcome < GameOutcomesCount; outcome++) {
+        double share = 0;
+        double shareVariance = 0;
+        double stepsTotal = 0;
+        for (const SamplingStratum& stratum : strata) {
+            const double n = static_cast<double>(stratum.games);
+            const double p = stratum.outcomeGames[outcome] / n;
+            share += stratum.weight * p;
+            stepsTotal += stratum.weight * stratum.stepsSum[outcome] / n;
+            if (!stratum.playedThrough) {
+                shareVariance += stratum.weight * stratum.weight * p * (1 - p) / (n - 1);
+            }
+        }
+        const double ratio = share > 0 ? stepsTotal / share : 0;
+        double ratioVariance = 0;
+        for (const SamplingStratum& stratum : strata) {
+            if (stratum.playedThrough || share == 0) {
+                continue;
+            }
+            // the variance of steps - ratio over the stratum's games, counting the games with other outcomes as 0
+            const double n = static_cast<double>(stratum.games);
+            const double c = static_cast<double>(stratum.outcomeGames[outcome]);
+            const double s = stratum.stepsSum[outcome];
+            const double q = stratum.stepsSquaresSum[outcome];
+            const double deviationsSum = s - ratio * c;
+            const double deviationsSquares = q - 2 * ratio * s + ratio * ratio * c;
+            ratioVariance += stratum.weight * stratum.weight * (deviationsSquares - deviationsSum * deviationsSum / n) / (n - 1) / n;
+        }
+        sampled->outcomeShare[outcome].value = 100 * share;
+        sampled->outcomeShare[outcome].halfWidth = 100 * Z95 * std::sqrt(shareVariance);
+        sampled->avgSteps[outcome].value = ratio;
+        sampled->avgSteps[outcome].halfWidth = share > 0 ? Z95 * std::sqrt(std::max(0.0, ratioVariance)) / share : 0;
+    }
+}
+
+// Plays seeded samples from every stratum in rounds of about options.roundGames games, each stratum getting games
+// in proportion to its size, until the precision, time or games limit of the options is met.
+SampledStats SampleStats(uint64_t lo, uint64_t hi, const SamplingOptions& options = SamplingOptions()) {
+    using Clock = std::chrono::steady_clock;
+    const Clock::time_point start = Clock::now();
+    SampledStats sampled;
+    if (lo > hi) {
+        return sampled;
+    }
+    std::vector<SamplingStratum> strata = MakeSamplingStrata(lo, hi, options);
+    sampled.strataCount = strata.size();
+    WorkStealingPool pool(options.threadCount);
+    std::vector<uint64_t> startValues;
+    std::vector<size_t> valueStrata;
+    std::vector<GameResults> results;
+    for (;;) {
+        startValues.clear();
+        valueStrata.clear();
+        for (size_t index = 0; index < strata.size(); index++) {
+            SamplingStratum& stratum = strata[index];
+            if (stratum.playedThrough) {
+                continue;
+            }
+            const uint64_t size = stratum.hi - stratum.lo + 1;
+            const uint64_t games = std::max(options.minStratumGames, static_cast<uint64_t>(std::llround(stratum.weight * options.roundGames)));
+            if (size <= games && stratum.games == 0) {
+                stratum.playedThrough = true;
+                for (uint64_t n = stratum.lo; n <= stratum.hi; n++) {
+                    startValues.push_back(n);
+                    valueStrata.push_back(index);
+                }
+                continue;
+            }
+            // a multiply-shift of the raw draws rather than std::uniform_int_distribution, whose output differs
+            // between standard libraries, so that a seed samples the same games everywhere
+            for (uint64_t game = 0; game < games; game++) {
+                startValues.push_back(stratum.lo + MulHigh(stratum.random(), size));
+                valueStrata.push_back(index);
+            }
+        }
+        if (startValues.empty()) {
+            break;
+        }
+        results.resize(startValues.size());
+        const size_t chunkSize = 1 << 12;
+        pool.Run((startValues.size() + chunkSize - 1) / chunkSize, [&](unsigned, uint64_t chunk) {
+            const size_t begin = chunk * chunkSize;
+            const size_t count = std::min(chunkSize, startValues.size() - begin);
+            if (options.rules == RulesVariant()) {
+                PlayBatch(startValues.data() + begin, count, results.data() + begin);
+                return;
+            }
+            VisitRules(options.rules, [&](auto rules) {
+                for (size_t i = begin; i < begin + count; i++) {
+                    results[i] = Play<decltype(rules)>(startValues[i]);
+                }
+            });
+        });
+        for (size_t i = 0; i < results.size(); i++) {
+            strata[valueStrata[i]].AddRun(results[i]);
+        }
+        sampled.gamesPlayed += results.size();
+        sampled.rounds++;
+
+        EstimateSampledStats(strata, &sampled);
+        double widestShare = 0;
+        for (const SampleEstimate& share : sampled.outcomeShare) {
+            widestShare = std::max(widestShare, share.halfWidth);
+        }
+        sampled.elapsedSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+        if (widestShare <= options.precisionPercent || sampled.elapsedSeconds >= options.timeBudgetSeconds
+            || sampled.gamesPlayed >= options.maxGames) {
+            break;
+        }
+    }
+    sampled.exhaustive = std::all_of(strata.begin(), strata.end(), [](const SamplingStratum& stratum) { return stratum.playedThrough; });
+    sampled.elapsedSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+    return sampled;
+}
+
+// largest winner search //////////////////////////////////////////////////////////////////////////
+
+struct WinnerSearchOptions {
+    unsigned threadCount = 0;
+    uint64_t blockSize = 1 << 12;
+};
+
+// Returns up to count winning start values in [lo, hi], largest first.
+// Workers claim descending blocks in order and stop once the completed prefix of blocks holds count winners.
+std::vector<uint64_t> FindLargestWinners(uint64_t lo, uint64_t hi, size_t count,
+    const WinnerSearchOptions& options = WinnerSearchOptions()) {
+    std::vector<uint64_t> winners;
+    if (lo > hi || count == 0) {
+        return winners;
+    }
+    const uint64_t blockSize = std::max<uint64_t>(1, options.blockSize);
+    const uint64_t blockCount = (hi - lo) / blockSize + 1;
+    std::atomic<uint64_t> nextBlock{ 0 };
+    std::atomic<uint64_t> stopBlock{ blockCount };
+    std::mutex mutex;
+    std::map<uint64_t, std::vector<uint64_t>> completedBlocks;
+    uint64_t completedPrefix = 0;
+
+    auto worker = [&]() {
+        std::vector<uint64_t> blockWinners;
+        for (uint64_t block = nextBlock++; block < stopBlock.load(); block = nextBlock++) {
+            blockWinners.clear();
+            uint64_t blockHi = hi - block * blockSize;
+            uint64_t blockLo = (blockHi - lo < blockSize) ? lo : blockHi - (blockSize - 1);
+            for (uint64_t n = blockHi; blockWinners.size() < count && block < stopBlock.load(std::memory_order_relaxed); n--) {
+                if (Play(n).outcome == GameOutcome::finished) {
+                    blockWinners.push_back(n);
+                }
+                if (n == blockLo) {
+                    break;
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (block >= stopBlock.load()) {
+                break;
+            }
+            completedBlocks[block] = blockWinners;
+            for (auto it = completedBlocks.begin(); it != completedBlocks.end() && it->first == completedPrefix; it = completedBlocks.erase(it)) {
+                winners.insert(winners.end(), it->second.begin(), it->second.end());
+                completedPrefix++;
+            }
+            if (winners.size() >= count) {
+                stopBlock = completedPrefix;
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned i = 1; i < DefaultThreadCount(options.threadCount); i++) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    if (winners.size() > count) {
+        winners.resize(count);
+    }
+    return winners;
+}
+
+std::optional<uint64_t> FindLargestWinner(uint64_t lo, uint64_t hi,
+    const WinnerSearchOptions& options = WinnerSearchOptions()) {
+    std::vector<uint64_t> winners = FindLargestWinners(lo, hi, 1, options);
+    return winners.empty() ? std::nullopt : std::optional<uint64_t>{ winners.front() };
+}
+
+// backward search ////////////////////////////////////////////////////////////////////////////////
+
+// A state's predecessors are found by inverting the step that reaches it: a division leaves the
+// dividend in a narrow interval around target * divisor and a multiplication leaves the state's
+// digits in one around target / multiplier. Candidates are confirmed with the forward step, so the
+// enumerations below only need to cover every predecessor, not to avoid false ones.
+// Products are kept in 64 bits, which holds up to ten digits.
+
+// Calls visit(n) for each n in [lo, hi] with n % modulus == residue, residue < modulus.
+template <typename Visitor>
+void ForEachInResidueClass(uint64_t lo, uint64_t hi, uint64_t residue, uint64_t modulus, Visitor&& visit) {
+    if (lo > hi) {
+        return;
+    }
+    for (uint64_t n = lo + (residue + modulus - lo % modulus) % modulus; n >= lo && n <= hi; n += modulus) {
+        visit(n);
+    }
+}
+
+// Calls visit(divisor, 10^k) for every suffix divisor of a k digit suffix: the shortest suffix above
+// one is a nonzero digit followed by zeros and a final 0 or 1, or a single digit from 2.
+template <typename Rules, typename Visitor>
+void ForEachSuffixDivisor(Visitor&& visit) {
+    for (uint64_t digit = 2; digit <= 9; digit++) {
+        visit(digit, 10);
+    }
+    for (int length = 2; length <= Rules::Digits; length++) {
+        for (uint64_t digit = 1; digit <= 9; digit++) {
+            visit(digit * PowersOfTen[length - 1], PowersOfTen[length]);
+            visit(digit * PowersOfTen[length - 1] + 1, PowersOfTen[length]);
+        }
+    }
+}
+
+// Integers whose step lands on target.
+template <typename Rules>
+void AppendDivisionPredecessors(const CalculatorState& target, std::vector<CalculatorState>* predecessors) {
+    static_assert(Rules::Digits <= 10, "the backward search keeps its products in 64 bits");
+    const uint64_t intPart = target.GetIntPart();
+    const int fractionDigits = Rules::Digits - DigitsCount(intPart);
+    if (intPart == 0 || target.fractionDigits > fractionDigits) {
+        return;
+    }
+    // n / divisor truncates to target: n * scale is in [displayed * divisor, (displayed + 1) * divisor)
+    const uint64_t scale = PowersOfTen[fractionDigits];
+    const uint64_t displayed = target.digits * PowersOfTen[fractionDigits - target.fractionDigits];
+    const uint64_t maxDivisor = ((Rules::MaxIntValue + 1) * scale - 1) / displayed;
+    auto verify = [&](uint64_t n) {
+        if (NextStepForInt<Rules>(n) == target) {
+            predecessors->push_back(CalculatorState{ n, 0 });
+        }
+    };
+    auto visitDivisor = [&](uint64_t divisor, uint64_t modulus) {
+        if (divisor <= maxDivisor) {
+            uint64_t lo = std::max<uint64_t>(10, (displayed * divisor + scale - 1) / scale);
+            uint64_t hi = std::min(Rules::MaxIntValue, ((displayed + 1) * divisor - 1) / scale);
+            ForEachInResidueClass(lo, hi, divisor, modulus, verify);
+        }
+    };
+    ForEachSuffixDivisor<Rules>(visitDivisor);
+
+    if constexpr (Rules::RepeatingDigitsRule) {
+        if (displayed <= scale) {
+            return;
+        }
+        for (int length = 1; length <= Rules::Digits - 2; length++) {
+            // n = head * modulus + divisor, head ends in the repeated pair and n / divisor > head + 1
+            const uint64_t modulus = PowersOfTen[length];
+            const uint64_t maxHead = std::min(PowersOfTen[Rules::Digits - length] - 1, intPart);
+            if (maxHead / 10 >= modulus) {
+                // n >= 11 * modulus bounds the divisor from below
+                for (uint64_t divisor = std::max<uint64_t>(2, 11 * modulus * scale / (displayed + 1)); divisor < modulus; divisor++) {
+                    visitDivisor(divisor, modulus);
+                }
+                continue;
+            }
+            for (uint64_t prefix = 1; prefix * 10 + prefix % 10 <= maxHead; prefix++) {
+                uint64_t head = prefix * 10 + prefix % 10;
+                uint64_t scaledHead = head * modulus * scale;
+                uint64_t minDivisor = std::max<uint64_t>(2, scaledHead / (displayed + 1 - scale) + 1);
+                uint64_t maxHeadDivisor = std::min(modulus - 1, scaledHead / (displayed - scale));
+                for (uint64_t divisor = minDivisor; divisor <= maxHeadDivisor; divisor++) {
+                    verify(head * modulus + divisor);
+                }
+            }
+        }
+    }
+}
+
+// Non-integer states whose step lands on target. The multiplier is the fraction's digits, or when
+// those read 1 the shortest suffix of all the digits above one.
+template <typename Rules>
+void AppendMultiplicationPredecessors(const CalculatorState& target, std::vector<CalculatorState>* predecessors) {
+    static_assert(Rules::Digits <= 10, "the backward search keeps its products in 64 bits");
+    const uint64_t intPart = target.GetIntPart();
+    if (target.IsOverflow() || intPart < 20) {
+        return;
+    }
+    const int intDigits = DigitsCount(intPart);
+    for (int fractionDigits = 1; fractionDigits <= Rules::Digits - 2; fractionDigits++) {
+        auto verify = [&](uint64_t digits) {
+            CalculatorState n{ digits, fractionDigits };
+            if (digits <= Rules::MaxIntValue && digits % 10 != 0 && n.GetIntPart() >= 10
+                && NextStepForNonInt<Rules>(n) == target) {
+                predecessors->push_back(n);
+            }
+        };
+        // digits * multiplier truncates to target: it is in [lo, lo + shift)
+        const int productFractionDigits = std::min(fractionDigits, Rules::Digits - intDigits);
+        if (target.fractionDigits > productFractionDigits) {
+            continue;
+        }
+        const uint64_t shift = PowersOfTen[fractionDigits - productFractionDigits];
+        const uint64_t lo = target.digits * PowersOfTen[productFractionDigits - target.fractionDigits] * shift;
+        const uint64_t hi = lo + shift;
+        const uint64_t scale = PowersOfTen[fractionDigits];
+
+        // A fraction of two or more is the multiplier: digits = stateIntPart * scale + fraction. The product
+        // is below (stateIntPart + 1) * scale * scale and at least 10 * scale * fraction, which bounds both;
+        // walk whichever range is shorter and solve for the other.
+        const uint64_t minIntPart = std::max<uint64_t>(10, lo / (scale * scale));
+        const uint64_t maxIntPart = std::min(PowersOfTen[Rules::Digits - fractionDigits] - 1, intPart / 2);
+        const uint64_t minFraction = std::max<uint64_t>(2, lo / ((maxIntPart + 1) * scale));
+        const uint64_t maxFraction = std::min(scale - 1, (hi - 1) / (10 * scale));
+        if (minIntPart > maxIntPart || minFraction > maxFraction) {
+            // no candidates
+        } else if ((maxIntPart - minIntPart) * 4 * fractionDigits < maxFraction - minFraction) {
+            for (uint64_t stateIntPart = minIntPart; stateIntPart <= maxIntPart; stateIntPart++) {
+                auto product = [&](uint64_t fraction) { return (stateIntPart * scale + fraction) * fraction; };
+                uint64_t first = minFraction;
+                uint64_t last = maxFraction + 1;
+                while (first < last) {
+                    uint64_t middle = first + (last - first) / 2;
+                    if (product(middle) < lo) {
+                        first = middle + 1;
+                    } else {
+                        last = middle;
+                    }
+                }
+                for (uint64_t fraction = first; fraction <= maxFraction && product(fraction) < hi; fraction++) {
+                    verify(stateIntPart * scale + fraction);
+                }
+            }
+        } else {
+            for (uint64_t fraction = minFraction; fraction <= maxFraction; fraction++) {
+                uint64_t square = fraction * fraction;
+                uint64_t firstIntPart = lo > square ? (lo - square + scale * fraction - 1) / (scale * fraction) : 0;
+                uint64_t lastIntPart = std::min(maxIntPart, (hi - 1 - square) / (scale * fraction));
+                for (uint64_t stateIntPart = std::max(minIntPart, firstIntPart); stateIntPart <= lastIntPart; stateIntPart++) {
+                    verify(stateIntPart * scale + fraction);
+                }
+            }
+        }
+
+        // A fraction of 1 extends the multiplier into the integer digits up to the next nonzero one.
+        for (int length = fractionDigits + 1; length <= Rules::Digits; length++) {
+            for (uint64_t digit = 1; digit <= 9; digit++) {
+                uint64_t multiplier = digit * PowersOfTen[length - 1] + 1;
+                ForEachInResidueClass((lo + multiplier - 1) / multiplier, (hi - 1) / multiplier,
+                    multiplier, PowersOfTen[length], verify);
+            }
+        }
+    }
+}
+
+// Every state whose step lands on target, in ascending order.
+template <typename Rules = DefaultRules>
+std::vector<CalculatorState> FindPredecessors(const CalculatorState& target) {
+    std::vector<CalculatorState> predecessors;
+    AppendDivisionPredecessors<Rules>(target, &predecessors);
+    AppendMultiplicationPredecessors<Rules>(target, &predecessors);
+    auto less = [](const CalculatorState& a, const CalculatorState& b) {
+        return a.fractionDigits != b.fractionDigits ? a.fractionDigits < b.fractionDigits : a.digits < b.digits;
+    };
+    std::sort(predecessors.begin(), predecessors.end(), less);
+    predecessors.erase(std::unique(predecessors.begin(), predecessors.end()), predecessors.end());
+    return predecessors;
+}
+
+// The states one step from a finish. They are all integers: a multiplication from 10 or more by 2
+// or more cannot go below 20, and a division leaves below 10 only when the divisor is above n / 10.
+template <typename Rules = DefaultRules>
+std::vector<GameResults> FindFinishingStates() {
+    std::vector<GameResults> states;
+    ForEachSuffixDivisor<Rules>([&](uint64_t divisor, uint64_t modulus) {
+        uint64_t hi = std::min(Rules::MaxIntValue, 10 * divisor - 1);
+        ForEachInResidueClass(std::max<uint64_t>(10, divisor), hi, divisor, modulus, [&](uint64_t n) {
+            CalculatorState next = NextStepForInt<Rules>(n);
+            if (next.GetIntPart() < 10) {
+                GameResults results;
+                results.startValue = n;
+                results.outcome = GameOutcome::finished;
+                results.stepsCount = 1;
+                results.finalValue = std::optional<CalculatorState>{ next };
+                states.push_back(results);
+            }
+        });
+    });
+    std::sort(states.begin(), states.end(), [](const GameResults& a, const GameResults& b) { return a.startValue < b.startValue; });
+    states.erase(std::unique(states.begin(), states.end(),
+        [](const GameResults& a, const GameResults& b) { return a.startValue == b.startValue; }), states.end());
+    return states;
+}
+
+struct BackwardSearchOptions {
+    unsigned threadCount = 0;
+    int maxSteps = INT32_MAX;       // stop after the winners of this many steps, the rules' cap applies too
+    uint64_t statesExpanded = 0;    // out: states whose predecessors were searched
+};
+
+// The results of every winning start value in [lo, hi], by breadth-first search out from the
+// finishing states; with maxSteps, of those that finish within it. NextStep is a function, so the predecessor graph of the finishes is a forest
+// and each state is reached once; a level holds every state that finishes in that many steps.
+template <typename Rules = DefaultRules>
+std::vector<GameResults> FindWinnersBackward(uint64_t lo, uint64_t hi, BackwardSearchOptions* options = nullptr) {
+    struct Node {
+        CalculatorState state;
+        CalculatorState finalValue;
+    };
+    std::vector<GameResults> winners;
+    for (uint64_t n = lo; n <= std::min<uint64_t>(hi, 9); n++) {
+        winners.push_back(Play<Rules>(n));
+    }
+    std::vector<Node> level;
+    for (const GameResults& results : FindFinishingStates<Rules>()) {
+        level.push_back(Node{ CalculatorState{ results.startValue, 0 }, *results.finalValue });
+    }
+    const unsigned threadCount = DefaultThreadCount(options != nullptr ? options->threadCount : 0);
+    const int maxSteps = std::min(Rules::MaxMoves - 1, options != nullptr ? options->maxSteps : INT32_MAX);
+    uint64_t statesExpanded = 0;
+    for (int steps = 1; !level.empty() && steps <= maxSteps; steps++) {
+        for (const Node& node : level) {
+            if (node.state.IsInteger() && node.state.digits >= lo && node.state.digits <= hi) {
+                GameResults results;
+                results.startValue = node.state.digits;
+                results.outcome = GameOutcome::finished;
+                results.stepsCount = steps;
+                results.finalValue = std::optional<CalculatorState>{ node.finalValue };
+                winners.push_back(results);
+            }
+        }
+        if (steps == maxSteps) {
+            break;
+        }
+        statesExpanded += level.size();
+        // Threads expand interleaved slices of the level; each slice's predecessors stay together.
+        std::vector<std::vector<Node>> nextLevels(threadCount);
+        auto expand = [&](unsigned thread) {
+            for (size_t i = thread; i < level.size(); i += threadCount) {
+                for (const CalculatorState& predecessor : FindPredecessors<Rules>(level[i].state)) {
+                    nextLevels[thread].push_back(Node{ predecessor, level[i].finalValue });
+                }
+            }
+        };
+        std::vector<std::thread> threads;
+        for (unsigned thread = 1; thread < threadCount; thread++) {
+            threads.emplace_back(expand, thread);
+        }
+        expand(0);
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        level.clear();
+        for (const auto& nextLevel : nextLevels) {
+            level.insert(level.end(), nextLevel.begin(), nextLevel.end());
+        }
+    }
+    if (options != nullptr) {
+        options->statesExpanded = statesExpanded;
+    }
+    std::sort(winners.begin(), winners.end(), [](const GameResults& a, const GameResults& b) { return a.startValue < b.startValue; });
+    return winners;
+}
+
+// checkpointed sweep /////////////////////////////////////////////////////////////////////////////
+
+constexpr size_t SweepWinnersKept = 10;
+
+// Everything a sweep has accumulated so far, enough to resume it from a file.
+struct SweepProgress {
+    uint64_t lo = 0;
+    uint64_t hi = 0;
+    uint64_t chunkSize = 1;
+    RulesVariant rules;
+    std::vector<uint64_t> completedChunks;
+    OverallStats stats;
+    // largest first, at most SweepWinnersKept
+    std::vector<uint64_t> largestWinners;
+
+    void Reset(uint64_t _lo, uint64_t _hi, uint64_t _chunkSize);
+    uint64_t GetChunkCount() const { return (hi - lo) / chunkSize + 1; }
+    bool IsChunkCompleted(uint64_t chunk) const { return (completedChunks[chunk / 64] >> (chunk % 64)) & 1; }
+    uint64_t GetCompletedChunksCount() const;
+    void AddChunk(uint64_t chunk, const OverallStats& chunkStats, const std::vector<uint64_t>& chunkWinners);
+    // Writes a temporary file next to path and renames it over path, so path always holds a whole checkpoint.
+    bool Save(const std::string& path) const;
+    bool Load(const std::string& path);
+};
+
+void SweepProgress::Reset(uint64_t _lo, uint64_t _hi, uint64_t _chunkSize) {
+    lo = _lo;
+    hi = _hi;
+    chunkSize = std::max<uint64_t>(1, _chunkSize);
+    completedChunks.assign((GetChunkCount() + 63) / 64, 0);
+    stats = OverallStats();
+    largestWinners.clear();
+}
+
+uint64_t SweepProgress::GetCompletedChunksCount() const {
+    uint64_t count = 0;
+    for (uint64_t word : completedChunks) {
+        for (; word != 0; word &= word - 1) {
+            count++;
+        }
+    }
+    return count;
+}
+
+void SweepProgress::AddChunk(uint64_t chunk, const OverallStats& chunkStats, const std::vector<uint64_t>& chunkWinners) {
+    completedChunks[chunk / 64] |= 1ull << (chunk % 64);
+    stats.Merge(chunkStats);
+    largestWinners.insert(largestWinners.end(), chunkWinners.begin(), chunkWinners.end());
+    std::sort(largestWinners.begin(), largestWinners.end(), std::greater<uint64_t>());
+    largestWinners.resize(std::min(largestWinners.size(), SweepWinnersKept));
+}
+
+bool SweepProgress::Save(const std::string& path) const {
+    const std::string temporaryPath = path + ".tmp";
+    {
+        std::ofstream out(temporaryPath, std::ios::trunc);
+        out << "CalcGameCheckpoint 2\n"
+            << "rules " << rules.digits << ' ' << rules.maxMoves << ' ' << rules.twoRepeatingDigitsRule << '\n'
+            << "range " << lo << ' ' << hi << ' ' << chunkSize << '\n'
+            << "stats ";
+        stats.Serialize(out);
+        out << "\nwinners " << largestWinners.size();
+        for (uint64_t winner : largestWinners) {
+            out << ' ' << winner;
+        }
+        out << "\nchunks " << completedChunks.size() << std::hex;
+        for (uint64_t word : completedChunks) {
+            out << ' ' << word;
+        }
+        out << '\n';
+        if (!out.flush()) {
+            return false;
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(temporaryPath, path, error);
+    return !error;
+}
+
+bool SweepProgress::Load(const std::string& path) {
+    std::ifstream in(path);
+    std::string word;
+    int version;
+    if (!(in >> word >> version) || word != "CalcGameCheckpoint" || version != 2
+        || !(in >> word >> rules.digits >> rules.maxMoves >> rules.twoRepeatingDigitsRule) || word != "rules"
+        || !(in >> word >> lo >> hi >> chunkSize) || word != "range" || lo > hi || chunkSize == 0
+        || !(in >> word) || word != "stats" || !stats.Deserialize(in)) {
+        return false;
+    }
+    size_t count;
+    if (!(in >> word >> count) || word != "winners" || count > SweepWinnersKept) {
+        return false;
+    }
+    largestWinners.resize(count);
+    for (uint64_t& winner : largestWinners) {
+        in >> winner;
+    }
+    if (!(in >> word >> count) || word != "chunks" || count != (GetChunkCount() + 63) / 64) {
+        return false;
+    }
+    completedChunks.resize(count);
+    in >> std::hex;
+    for (uint64_t& chunkWord : completedChunks) {
+        in >> chunkWord;
+    }
+    return static_cast<bool>(in);
+}
+
+struct CheckpointOptions {
+    std::string path;
+    unsigned intervalSeconds = 60;
+};
+
+// Sweeps [lo, hi] like SweepStats and also keeps the largest winners. With checkpoint.path set it resumes from
+// that file when it exists and rewrites it every checkpoint.intervalSeconds. Workers only queue their finished
+// chunks; a background thread folds them into the progress and saves it. False if the file is for another sweep.
+bool SweepWithCheckpoints(uint64_t lo, uint64_t hi, const SweepOptions& options, const CheckpointOptions& checkpoint,
+    SweepProgress* progress) {
+    SweepOptions chunkOptions = options;
+    if (options.resultsWriter != nullptr) {
+        chunkOptions.chunkSize = options.resultsWriter->GetHeader().blockSize;
+    }
+    chunkOptions.chunkSize = std::max<uint64_t>(1, chunkOptions.chunkSize);
+    if (checkpoint.path.empty() || !std::filesystem::exists(checkpoint.path)) {
+        progress->Reset(lo, hi, chunkOptions.chunkSize);
+        progress->rules = options.rules;
+    }
+    else if (!progress->Load(checkpoint.path) || progress->lo != lo || progress->hi != hi
+        || progress->chunkSize != chunkOptions.chunkSize || progress->rules != options.rules) {
+        return false;
+    }
+    const std::vector<uint64_t> completedBefore = progress->completedChunks;
+
+    struct CompletedChunk {
+        uint64_t chunk;
+        OverallStats stats;
+        std::vector<uint64_t> winners;
+    };
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::vector<CompletedChunk> pending;
+    bool done = false;
+    auto drain = [&]() {
+        std::vector<CompletedChunk> completed;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            completed.swap(pending);
+        }
+        for (const CompletedChunk& chunk : completed) {
+            progress->AddChunk(chunk.chunk, chunk.stats, chunk.winners);
+        }
+    };
+    std::thread checkpointer([&]() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!done) {
+            wake.wait_for(lock, std::chrono::seconds(checkpoint.intervalSeconds));
+            lock.unlock();
+            drain();
+            if (!checkpoint.path.empty()) {
+                progress->Save(checkpoint.path);
+            }
+            lock.lock();
+        }
+    });
+
+    WorkStealingPool pool(options.threadCount);
+    SweepChunks(lo, hi, chunkOptions, [&](unsigned, uint64_t chunkLo, uint64_t chunkHi) {
+        const uint64_t chunk = (chunkLo - lo) / chunkOptions.chunkSize;
+        if ((completedBefore[chunk / 64] >> (chunk % 64)) & 1) {
+            return;
+        }
+        std::vector<GameResults> results;
+        PlaySweepChunk(chunkLo, chunkHi, chunkOptions, &results);
+        CompletedChunk completed{ chunk, OverallStats(), {} };
+        for (auto game = results.rbegin(); game != results.rend() && completed.winners.size() < SweepWinnersKept; ++game) {
+            if (game->outcome == GameOutcome::finished) {
+                completed.winners.push_back(game->startValue);
+            }
+        }
+        for (GameResults& gameResults : results) {
+            completed.stats.AddRun(std::move(gameResults));
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.push_back(std::move(completed));
+    }, pool);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        done = true;
+    }
+    wake.notify_one();
+    checkpointer.join();
+    drain();
+    return checkpoint.path.empty() || progress->Save(checkpoint.path);
+}
+
+// sharded sweeps /////////////////////////////////////////////////////////////////////////////////
+
+// Shard index of count is a contiguous run of whole chunks of [lo, hi]. Every process given the same arguments
+// sweeps the same values, and each shard starts on a chunk so that its results file can too. False for an empty shard.
+bool GetShardRange(uint64_t lo, uint64_t hi, uint64_t chunkSize, uint64_t index, uint64_t count,
+    uint64_t* shardLo, uint64_t* shardHi) {
+    if (lo > hi || index >= count) {
+        return false;
+    }
+    const uint64_t chunkCount = (hi - lo) / chunkSize + 1;
+    uint64_t unused;
+    const uint64_t firstChunk = MulDivMod(chunkCount, index, count, &unused);
+    const uint64_t endChunk = MulDivMod(chunkCount, index + 1, count, &unused);
+    if (firstChunk == endChunk) {
+        return false;
+    }
+    *shardLo = lo + firstChunk * chunkSize;
+    *shardHi = endChunk == chunkCount ? hi : lo + endChunk * chunkSize - 1;
+    return true;
+}
+
+struct MergedShards {
+    RulesVariant rules;
+    OverallStats stats;
+    std::vector<uint64_t> largestWinners;
+    // the covered ranges, ascending, with adjacent shards joined
+    std::vector<std::pair<uint64_t, uint64_t>> ranges;
+};
+
+// Combines the partial results shards saved into the report of their union. False if the shards differ in rules,
+// overlap or are not finished. Gaps between shards are allowed and show up in the ranges.
+bool MergeShards(std::vector<SweepProgress> shards, MergedShards* merged) {
+    std::sort(shards.begin(), shards.end(), [](const SweepProgress& a, const SweepProgress& b) { return a.lo < b.lo; });
+    *merged = MergedShards();
+    for (size_t i = 0; i < shards.size(); i++) {
+        const SweepProgress& shard = shards[i];
+        if (shard.rules != shards.front().rules || shard.GetCompletedChunksCount() != shard.GetChunkCount()
+            || (i > 0 && shard.lo <= shards[i - 1].hi)) {
+            return false;
+        }
+        merged->rules = shard.rules;
+        merged->stats.Merge(shard.stats);
+        merged->largestWinners.insert(merged->largestWinners.end(), shard.largestWinners.begin(), shard.largestWinners.end());
+        if (!merged->ranges.empty() && merged->ranges.back().second + 1 == shard.lo) {
+            merged->ranges.back().second = shard.hi;
+        } else {
+            merged->ranges.emplace_back(shard.lo, shard.hi);
+        }
+    }
+    std::sort(merged->largestWinners.begin(), merged->largestWinners.end(), std::greater<uint64_t>());
+    merged->largestWinners.resize(std::min(merged->largestWinners.size(), SweepWinnersKept));
+    return true;
+}
+
+// winner index ///////////////////////////////////////////////////////////////////////////////////
+
+// The winners of [lo, hi] split by their upper bits into blocks of 2^16 values, roaring style: a block with few
+// winners stores the sorted low 16 bits of each, a denser one a 2^16 bit bitmap. A directory entry per block holds
+// the winners before it, so rank and select only touch the directory and one container.
+struct WinnerIndexHeader {
+    char magic[8] = { 'C', 'A', 'L', 'C', 'W', 'I', 'N', '\0' };
+    uint32_t version = 1;
+    uint32_t digitsInCalculator = DigitsInCalculator;
+    uint32_t maxMoves = MaxMoves;
+    uint32_t twoRepeatingDigitsRule = ImplementTwoRepeatingDigitsRule;
+    uint64_t lo = 0;
+    uint64_t hi = 0;
+    uint64_t winnersCount = 0;
+    uint64_t firstBlock = 0;
+    uint64_t blockCount = 0;
+
+    RulesVariant GetRules() const {
+        return RulesVariant{ static_cast<int>(digitsInCalculator), twoRepeatingDigitsRule != 0, static_cast<int>(maxMoves) };
+    }
+};
+static_assert(sizeof(WinnerIndexHeader) == 64, "the header is part of the file format");
+
+struct WinnerBlockEntry {
+    uint64_t offset = 0;
+    uint64_t rankBefore = 0;
+    uint32_t cardinality = 0;
+    uint32_t type = 0;
+};
+static_assert(sizeof(WinnerBlockEntry) == 24, "the directory is part of the file format");
+
+constexpr uint32_t WinnerArrayContainer = 1;
+constexpr uint32_t WinnerBitmapContainer = 2;
+constexpr int WinnerBlockBits = 16;
+constexpr uint64_t WinnerBlockSize = 1ull << WinnerBlockBits;
+constexpr uint64_t WinnerBitmapWords = WinnerBlockSize / 64;
+// a block with more winners takes less room as a bitmap
+constexpr uint32_t WinnerArrayMaxCardinality = 4096;
+
+int PopCount(uint64_t word) {
+#ifdef _MSC_VER
+    return static_cast<int>(__popcnt64(word));
+#else
+    return __builtin_popcountll(word);
+#endif
+}
+
+int LowestBit(uint64_t word) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, word);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctzll(word);
+#endif
+}
+
+// Sweeps [lo, hi] and writes the index of its finished games.
+bool BuildWinnerIndex(const std::string& path, uint64_t lo, uint64_t hi, const SweepOptions& options = SweepOptions(),
+    uint32_t arrayMaxCardinality = WinnerArrayMaxCardinality) {
+    if (lo > hi) {
+        return false;
+    }
+    WinnerIndexHeader header;
+    header.digitsInCalculator = options.rules.digits;
+    header.maxMoves = options.rules.maxMoves;
+    header.twoRepeatingDigitsRule = options.rules.twoRepeatingDigitsRule;
+    header.lo = lo;
+    header.hi = hi;
+    header.firstBlock = lo >> WinnerBlockBits;
+    header.blockCount = (hi >> WinnerBlockBits) - header.firstBlock + 1;
+
+    SweepOptions blockOptions = options;
+    blockOptions.resultsWriter = nullptr;
+    std::vector<std::vector<uint16_t>> blockWinners(header.blockCount);
+    WorkStealingPool pool(options.threadCount);
+    pool.Run(header.blockCount, [&](unsigned, uint64_t block) {
+        const uint64_t blockStart = (header.firstBlock + block) << WinnerBlockBits;
+        std::vector<GameResults> results;
+        PlaySweepChunk(std::max(lo, blockStart), std::min(hi, blockStart + WinnerBlockSize - 1), blockOptions, &results);
+        for (const GameResults& gameResults : results) {
+            if (gameResults.outcome == GameOutcome::finished) {
+                blockWinners[block].push_back(static_cast<uint16_t>(gameResults.startValue - blockStart));
+            }
+        }
+    });
+
+    std::vector<WinnerBlockEntry> directory(header.blockCount);
+    uint64_t offset = sizeof(header) + directory.size() * sizeof(WinnerBlockEntry);
+    for (uint64_t block = 0; block < header.blockCount; block++) {
+        WinnerBlockEntry& entry = directory[block];
+        entry.rankBefore = header.winnersCount;
+        entry.cardinality = static_cast<uint32_t>(blockWinners[block].size());
+        header.winnersCount += entry.cardinality;
+        if (entry.cardinality == 0) {
+            continue;
+        }
+        entry.offset = offset;
+        entry.type = entry.cardinality <= arrayMaxCardinality ? WinnerArrayContainer : WinnerBitmapContainer;
+        offset += entry.type == WinnerArrayContainer ? (entry.cardinality * sizeof(uint16_t) + 7) / 8 * 8 : WinnerBitmapWords * sizeof(uint64_t);
+    }
+
+    const std::string temporaryPath = path + ".tmp";
+    {
+        std::ofstream out(temporaryPath, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(directory.data()), directory.size() * sizeof(WinnerBlockEntry));
+        std::vector<uint64_t> bitmap(WinnerBitmapWords);
+        for (uint64_t block = 0; block < header.blockCount; block++) {
+            const std::vector<uint16_t>& winners = blockWinners[block];
+            if (directory[block].type == WinnerArrayContainer) {
+                const uint64_t zeros = 0;
+                out.write(reinterpret_cast<const char*>(winners.data()), winners.size() * sizeof(uint16_t));
+                out.write(reinterpret_cast<const char*>(&zeros), (8 - winners.size() * sizeof(uint16_t) % 8) % 8);
+            } else if (directory[block].type == WinnerBitmapContainer) {
+                std::fill(bitmap.begin(), bitmap.end(), 0);
+                for (uint16_t low : winners) {
+                    bitmap[low / 64] |= 1ull << (low % 64);
+                }
+                out.write(reinterpret_cast<const char*>(bitmap.data()), bitmap.size() * sizeof(uint64_t));
+            }
+        }
+        if (!out.flush()) {
+            return false;
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(temporaryPath, path, error);
+    return !error;
+}
+
+// Answers winner queries from a mapped index, the pages of the blocks asked about are all that is read.
+class WinnerIndex {
+public:
+    bool Open(const std::string& path);
+    const WinnerIndexHeader& GetHeader() const { return header_; }
+    uint64_t GetWinnersCount() const { return header_.winnersCount; }
+
+    bool Contains(uint64_t n) const;
+    // the winners in [lo, n]
+    uint64_t Rank(uint64_t n) const;
+    // the winner with rank winners before it
+    bool Select(uint64_t rank, uint64_t* winner) const;
+    // the largest winner up to n and the smallest from n on
+    bool Predecessor(uint64_t n, uint64_t* winner) const;
+    bool Successor(uint64_t n, uint64_t* winner) const;
+    uint64_t CountInRange(uint64_t a, uint64_t b) const;
+private:
+    WinnerBlockEntry GetEntry(uint64_t block) const;
+    template <typename T>
+    T ReadAt(uint64_t offset) const;
+    // the block's winners with a low part of at most low
+    uint64_t RankInBlock(const WinnerBlockEntry& entry, uint64_t low) const;
+    uint64_t SelectInBlock(const WinnerBlockEntry& entry, uint64_t rank) const;
+private:
+    MappedFile file_;
+    WinnerIndexHeader header_;
+};
+
+bool WinnerIndex::Open(const std::string& path) {
+    if (!file_.Open(path) || file_.GetSize() < sizeof(header_)) {
+        return false;
+    }
+    memcpy(&header_, file_.GetData(), sizeof(header_));
+    const WinnerIndexHeader expected;
+    if (memcmp(header_.magic, expected.magic, sizeof(expected.magic)) != 0 || header_.version != expected.version
+        || header_.lo > header_.hi || header_.firstBlock != header_.lo >> WinnerBlockBits
+        || header_.blockCount != (header_.hi >> WinnerBlockBits) - header_.firstBlock + 1
+        || file_.GetSize() < sizeof(header_) + header_.blockCount * sizeof(WinnerBlockEntry)) {
+        return false;
+    }
+    uint64_t winnersCount = 0;
+    for (uint64_t block = 0; block < header_.blockCount; block++) {
+        const WinnerBlockEntry entry = GetEntry(block);
+        const uint64_t size = entry.type == WinnerArrayContainer ? entry.cardinality * sizeof(uint16_t)
+            : entry.type == WinnerBitmapContainer ? WinnerBitmapWords * sizeof(uint64_t) : 0;
+        if (entry.rankBefore != winnersCount || entry.cardinality > WinnerBlockSize || (entry.cardinality != 0 && size == 0)
+            || entry.offset + size > file_.GetSize()) {
+            return false;
+        }
+        winnersCount += entry.cardinality;
+    }
+    return winnersCount == header_.winnersCount;
+}
+
+template <typename T>
+T WinnerIndex::ReadAt(uint64_t offset) const {
+    T value;
+    memcpy(&value, file_.GetData() + offset, sizeof(value));
+    return value;
+}
+
+WinnerBlockEntry WinnerIndex::GetEntry(uint64_t block) const {
+    return ReadAt<WinnerBlockEntry>(sizeof(header_) + block * sizeof(WinnerBlockEntry));
+}
+
+uint64_t WinnerIndex::RankInBlock(const WinnerBlockEntry& entry, uint64_t low) const {
+    if (entry.type == WinnerArrayContainer) {
+        uint64_t begin = 0;
+        uint64_t end = entry.cardinality;
+        while (begin < end) {
+            const uint64_t middle = (begin + end) / 2;
+            if (ReadAt<uint16_t>(entry.offset + middle * sizeof(uint16_t)) <= low) {
+                begin = middle + 1;
+            } else {
+                end = middle;
+            }
+        }
+        return begin;
+    }
+    if (entry.type == WinnerBitmapContainer) {
+        uint64_t rank = 0;
+        for (uint64_t word = 0; word < low / 64; word++) {
+            rank += PopCount(ReadAt<uint64_t>(entry.offset + word * sizeof(uint64_t)));
+        }
+        const uint64_t lastWord = ReadAt<uint64_t>(entry.offset + low / 64 * sizeof(uint64_t));
+        return rank + PopCount(low % 64 == 63 ? lastWord : lastWord & ((2ull << (low % 64)) - 1));
+    }
+    return 0;
+}
+
+uint64_t WinnerIndex::SelectInBlock(const WinnerBlockEntry& entry, uint64_t rank) const {
+    if (entry.type == WinnerArrayContainer) {
+        return ReadAt<uint16_t>(entry.offset + rank * sizeof(uint16_t));
+    }
+    for (uint64_t word = 0; ; word++) {
+        uint64_t bits = ReadAt<uint64_t>(entry.offset + word * sizeof(uint64_t));
+        const uint64_t count = PopCount(bits);
+        if (rank < count) {
+            for (; rank > 0; rank--) {
+                bits &= bits - 1;
+            }
+            return word * 64 + LowestBit(bits);
+        }
+        rank -= count;
+    }
+}
+
+bool WinnerIndex::Contains(uint64_t n) const {
+    if (n < header_.lo || n > header_.hi) {
+        return false;
+    }
+    const WinnerBlockEntry entry = GetEntry((n >> WinnerBlockBits) - header_.firstBlock);
+    const uint64_t low = n & (WinnerBlockSize - 1);
+    if (entry.type == WinnerBitmapContainer) {
+        return (ReadAt<uint64_t>(entry.offset + low / 64 * sizeof(uint64_t)) >> (low % 64)) & 1;
+    }
+    const uint64_t rank = RankInBlock(entry, low);
+    return rank > 0 && ReadAt<uint16_t>(entry.offset + (rank - 1) * sizeof(uint16_t)) == low;
+}
+
+uint64_t WinnerIndex::Rank(uint64_t n) const {
+    if (n < header_.lo) {
+        return 0;
+    }
+    n = std::min(n, header_.hi);
+    const WinnerBlockEntry entry = GetEntry((n >> WinnerBlockBits) - header_.firstBlock);
+    return entry.rankBefore + RankInBlock(entry, n & (WinnerBlockSize - 1));
+}
+
+bool WinnerIndex::Select(uint64_t rank, uint64_t* winner) const {
+    if (rank >= header_.winnersCount) {
+        return false;
+    }
+    // the last block that starts at or before the rank holds it
+    uint64_t begin = 0;
+    uint64_t end = header_.blockCount;
+    while (end - begin > 1) {
+        const uint64_t middle = (begin + end) / 2;
+        if (GetEntry(middle).rankBefore <= rank) {
+            begin = middle;
+        } else {
+            end = middle;
+        }
+    }
+    const WinnerBlockEntry entry = GetEntry(begin);
+    *winner = ((header_.firstBlock + begin) << WinnerBlockBits) + SelectInBlock(entry, rank - entry.rankBefore);
+    return true;
+}
+
+bool WinnerIndex::Predecessor(uint64_t n, uint64_t* winner) const {
+    const uint64_t rank = Rank(n);
+    return rank > 0 && Select(rank - 1, winner);
+}
+
+bool WinnerIndex::Successor(uint64_t n, uint64_t* winner) const {
+    return Select(n > header_.lo ? Rank(n - 1) : 0, winner);
+}
+
+uint64_t WinnerIndex::CountInRange(uint64_t a, uint64_t b) const {
+    return a > b ? 0 : Rank(b) - (a > 0 ? Rank(a - 1) : 0);
+}
+
+// block summary index ////////////////////////////////////////////////////////////////////////////
+
+// Steps below 32 have a bucket each, longer games share 4 buckets per power of two.
+constexpr int SummaryExactSteps = 32;
+constexpr int SummaryBucketsPerOctave = 4;
+constexpr int SummaryStepsBuckets = SummaryExactSteps + 11 * SummaryBucketsPerOctave;
+// finished, overflow, tooManyMoves and cycle
+constexpr size_t SummaryOutcomesCount = GameOutcomesCount - 1;
+// Leaves count their games in 32 bits, so a leaf covers at most 2^31 start values
+constexpr uint32_t MaxSummaryLeafBits = 31;
+
+int GetStepsBucket(int steps) {
+    if (steps < SummaryExactSteps) {
+        return steps;
+    }
+    const int octave = HighestBit(static_cast<uint32_t>(steps));
+    const int subBucket = (steps >> (octave - 2)) & (SummaryBucketsPerOctave - 1);
+    return std::min(SummaryStepsBuckets - 1, SummaryExactSteps + (octave - 5) * SummaryBucketsPerOctave + subBucket);
+}
+
+// The first steps count of a bucket; the bucket ends where the next one starts.
+int GetStepsBucketLow(int bucket) {
+    if (bucket < SummaryExactSteps) {
+        return bucket;
+    }
+    const int octave = 5 + (bucket - SummaryExactSteps) / SummaryBucketsPerOctave;
+    return (1 << octave) + ((bucket - SummaryExactSteps) % SummaryBucketsPerOctave << (octave - 2));
+}
+
+// The aggregates of a block of start values. Leaves count in 32 bits, a leaf has at most 2^MaxSummaryLeafBits
+// games, the levels above in 64.
+template <typename Count>
+struct BlockSummaryRecord {
+    Count games[SummaryOutcomesCount] = {};
+    uint64_t stepsSum[SummaryOutcomesCount] = {};
+    uint32_t maxSteps[SummaryOutcomesCount] = {};
+    Count finishedOn[10] = {};
+    Count stepsBuckets[SummaryOutcomesCount][SummaryStepsBuckets] = {};
+
+    template <typename OtherCount>
+    void Merge(const BlockSummaryRecord<OtherCount>& other) {
+        for (size_t outcome = 0; outcome < SummaryOutcomesCount; outcome++) {
+            games[outcome] += other.games[outcome];
+            stepsSum[outcome] += other.stepsSum[outcome];
+            maxSteps[outcome] = std::max(maxSteps[outcome], other.maxSteps[outcome]);
+            for (int bucket = 0; bucket < SummaryStepsBuckets; bucket++) {
+                stepsBuckets[outcome][bucket] += other.stepsBuckets[outcome][bucket];
+            }
+        }
+        for (size_t intPart = 0; intPart < 10; intPart++) {
+            finishedOn[intPart] += other.finishedOn[intPart];
+        }
+    }
+
+    void AddRun(const GameResults& results) {
+        const size_t outcome = static_cast<size_t>(results.outcome) - 1;
+        games[outcome]++;
+        stepsSum[outcome] += results.stepsCount;
+        maxSteps[outcome] = std::max(maxSteps[outcome], static_cast<uint32_t>(results.stepsCount));
+        stepsBuckets[outcome][GetStepsBucket(results.stepsCount)]++;
+        if (results.outcome == GameOutcome::finished) {
+            finishedOn[results.finalValue->GetIntPart()]++;
+        }
+    }
+};
+static_assert(sizeof(BlockSummaryRecord<uint32_t>) % 8 == 0, "records are packed back to back");
+
+// The OverallStats numbers of a range as the summary index knows them: counts, averages, maxima and where the game
+// ended are exact, percentiles are known to their steps bucket.
+class RangeSummary : public BlockSummaryRecord<uint64_t> {
+public:
+    uint64_t GetTotalGames() const;
+    // the steps bucket the percentile falls in, as its first and last steps count
+    void GetStepsPercentile(GameOutcome outcome, double fraction, int* low, int* high) const;
+    void Print() const;
+};
+
+uint64_t RangeSummary::GetTotalGames() const {
+    return std::accumulate(std::begin(games), std::end(games), uint64_t(0));
+}
+
+void RangeSummary::GetStepsPercentile(GameOutcome outcome, double fraction, int* low, int* high) const {
+    const size_t index = static_cast<size_t>(outcome) - 1;
+    const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(fraction * games[index])));
+    uint64_t runs = 0;
+    for (int bucket = 0; bucket < SummaryStepsBuckets; bucket++) {
+        runs += stepsBuckets[index][bucket];
+        if (runs >= rank) {
+            *low = GetStepsBucketLow(bucket);
+            *high = std::min<int>(maxSteps[index], bucket + 1 < SummaryStepsBuckets ? GetStepsBucketLow(bucket + 1) - 1 : INT32_MAX);
+            return;
+        }
+    }
+    *low = 0;
+    *high = 0;
+}
+
+void RangeSummary::Print() const {
+    const uint64_t totalGames = GetTotalGames();
+    auto printPercentile = [this](GameOutcome outcome, double fraction) {
+        int low;
+        int high;
+        GetStepsPercentile(outcome, fraction, &low, &high);
+        std::ostringstream text;
+        text << low;
+        if (high != low) {
+            text << "-" << high;
+        }
+        return text.str();
+    };
+    for (const auto gameOutcome : AllGameOutcomes) {
+        const size_t outcome = static_cast<size_t>(gameOutcome) - 1;
+        if (games[outcome] == 0) {
+            continue;
+        }
+        std::cout << "Outcome " << OverallStats::ToString(gameOutcome)
+            << " occured " << 100.0 * games[outcome] / totalGames << "% of times"
+            << " and finished in " << 1.0 * stepsSum[outcome] / games[outcome] << " of steps in average"
+            << " (p50 " << printPercentile(gameOutcome, 0.5) << ", p99 " << printPercentile(gameOutcome, 0.99)
+            << ", max " << maxSteps[outcome] << ")" << std::endl;
+    }
+    const uint64_t finishedGames = games[static_cast<size_t>(GameOutcome::finished) - 1];
+    if (finishedGames != 0) {
+        std::cout << "Finished games ended on";
+        for (size_t intPart = 0; intPart < 10; intPart++) {
+            std::cout << " " << intPart << ": " << 100.0 * finishedOn[intPart] / finishedGames << "%";
+        }
+        std::cout << std::endl;
+    }
+}
+
+// Leaves summarize blocks of 2^leafBits start values, aligned to multiples of their size, and every level above
+// sums fanout nodes of the one below until one node is left. The file holds the header, the leaves and then the
+// levels above, each level's nodes in order.
+struct SummaryIndexHeader {
+    char magic[8] = { 'C', 'A', 'L', 'C', 'S', 'U', 'M', '\0' };
+    uint32_t version = 1;
+    uint32_t digitsInCalculator = DigitsInCalculator;
+    uint32_t maxMoves = MaxMoves;
+    uint32_t twoRepeatingDigitsRule = ImplementTwoRepeatingDigitsRule;
+    uint32_t leafBits = 16;
+    uint32_t fanout = 64;
+    uint64_t lo = 0;
+    uint64_t hi = 0;
+    uint64_t firstLeaf = 0;
+    uint64_t leafCount = 0;
+
+    RulesVariant GetRules() const {
+        return RulesVariant{ static_cast<int>(digitsInCalculator), twoRepeatingDigitsRule != 0, static_cast<int>(maxMoves) };
+    }
+    uint64_t GetNodeCount(int level) const {
+        uint64_t count = leafCount;
+        for (int i = 0; i < level; i++) {
+            count = (count + fanout - 1) / fanout;
+        }
+        return count;
+    }
+    int GetLevelsCount() const {
+        int levels = 1;
+        while (GetNodeCount(levels - 1) > 1) {
+            levels++;
+        }
+        return levels;
+    }
+    uint64_t GetNodeOffset(int level, uint64_t node) const {
+        if (level == 0) {
+            return sizeof(SummaryIndexHeader) + node * sizeof(BlockSummaryRecord<uint32_t>);
+        }
+        uint64_t offset = sizeof(SummaryIndexHeader) + leafCount * sizeof(BlockSummaryRecord<uint32_t>);
+        for (int i = 1; i < level; i++) {
+            offset += GetNodeCount(i) * sizeof(BlockSummaryRecord<uint64_t>);
+        }
+        return offset + node * sizeof(BlockSummaryRecord<uint64_t>);
+    }
+};
+static_assert(sizeof(SummaryIndexHeader) == 64, "the header is part of the file format");
+
+// Sweeps [lo, hi] leaf by leaf and writes the summary index of it. The index is built next to path and renamed
+// over it, so a failed rebuild leaves the old index in place.
+bool BuildSummaryIndex(const std::string& path, uint64_t lo, uint64_t hi, const SweepOptions& options = SweepOptions(),
+    uint32_t leafBits = 16, uint32_t fanout = 64) {
+    if (lo > hi || leafBits == 0 || leafBits > MaxSummaryLeafBits || fanout < 2) {
+        return false;
+    }
+    SummaryIndexHeader header;
+    header.digitsInCalculator = options.rules.digits;
+    header.maxMoves = options.rules.maxMoves;
+    header.twoRepeatingDigitsRule = options.rules.twoRepeatingDigitsRule;
+    header.leafBits = leafBits;
+    header.fanout = fanout;
+    header.lo = lo;
+    header.hi = hi;
+    header.firstLeaf = lo >> leafBits;
+    header.leafCount = (hi >> leafBits) - header.firstLeaf + 1;
+    const std::string temporaryPath = path + ".tmp";
+    PositionedFile file;
+    if (!file.Create(temporaryPath)) {
+        return false;
+    }
+    std::atomic<bool> failed(!file.WriteAt(&header, sizeof(header), 0));
+
+    // the leaves go to the file as they are done, their parents stay in memory
+    SweepOptions leafOptions = options;
+    leafOptions.resultsWriter = nullptr;
+    std::vector<BlockSummaryRecord<uint64_t>> parents(header.GetNodeCount(1));
+    std::mutex parentsMutex;
+    WorkStealingPool pool(options.threadCount);
+    pool.Run(failed ? 0 : header.leafCount, [&](unsigned, uint64_t leaf) {
+        const uint64_t leafStart = (header.firstLeaf + leaf) << leafBits;
+        std::vector<GameResults> results;
+        PlaySweepChunk(std::max(lo, leafStart), std::min(hi, leafStart + ((uint64_t(1) << leafBits) - 1)), leafOptions, &results);
+        BlockSummaryRecord<uint32_t> record;
+        for (const GameResults& gameResults : results) {
+            record.AddRun(gameResults);
+        }
+        if (!file.WriteAt(&record, sizeof(record), header.GetNodeOffset(0, leaf))) {
+            failed = true;
+        }
+        std::lock_guard<std::mutex> lock(parentsMutex);
+        parents[leaf / fanout].Merge(record);
+    });
+    for (int level = 1; level < header.GetLevelsCount() && !failed; level++) {
+        if (!file.WriteAt(parents.data(), parents.size() * sizeof(parents[0]), header.GetNodeOffset(level, 0))) {
+            failed = true;
+        }
+        std::vector<BlockSummaryRecord<uint64_t>> grandparents(header.GetNodeCount(level + 1));
+        for (uint64_t node = 0; node < parents.size(); node++) {
+            grandparents[node / fanout].Merge(parents[node]);
+        }
+        parents.swap(grandparents);
+    }
+    file.Close();
+    std::error_code error;
+    if (failed) {
+        std::filesystem::remove(temporaryPath, error);
+        return false;
+    }
+    std::filesystem::rename(temporaryPath, path, error);
+    return !error;
+}
+
+// Answers range reports from a mapped summary index: the nodes covered by the range are merged level by level,
+// and only the games of the two partly covered leaves are looked up or played.
+class SummaryIndex {
+public:
+    bool Open(const std::string& path);
+    const SummaryIndexHeader& GetHeader() const { return header_; }
+    // The summary of [a, b] clipped to the index's range. The partly covered leaves' games come from results when
+    // it has them and are played otherwise.
+    RangeSummary GetRangeSummary(uint64_t a, uint64_t b, const ResultsFileReader* results = nullptr,
+        uint64_t* gamesPlayed = nullptr) const;
+private:
+    template <typename Count>
+    void MergeNode(int level, uint64_t node, RangeSummary* summary) const;
+private:
+    MappedFile file_;
+    SummaryIndexHeader header_;
+    int levelsCount_ = 0;
+};
+
+bool SummaryIndex::Open(const std::string& path) {
+    if (!file_.Open(path) || file_.GetSize() < sizeof(header_)) {
+        return false;
+    }
+    memcpy(&header_, file_.GetData(), sizeof(header_));
+    const SummaryIndexHeader expected;
+    if (memcmp(header_.magic, expected.magic, sizeof(expected.magic)) != 0 || header_.version != expected.version
+        || header_.lo > header_.hi || header_.leafBits == 0 || header_.leafBits > MaxSummaryLeafBits || header_.fanout < 2
+        || header_.firstLeaf != header_.lo >> header_.leafBits
+        || header_.leafCount != (header_.hi >> header_.leafBits) - header_.firstLeaf + 1) {
+        return false;
+    }
+    levelsCount_ = header_.GetLevelsCount();
+    return file_.GetSize() >= header_.GetNodeOffset(levelsCount_ - 1, header_.GetNodeCount(levelsCount_ - 1));
+}
+
+template <typename Count>
+void SummaryIndex::MergeNode(int level, uint64_t node, RangeSummary* summary) const {
+    BlockSummaryRecord<Count> record;
+    memcpy(&record, file_.GetData() + header_.GetNodeOffset(level, node), sizeof(record));
+    summary->Merge(record);
+}
+
+RangeSummary SummaryIndex::GetRangeSummary(uint64_t a, uint64_t b, const ResultsFileReader* results, uint64_t* gamesPlayed) const {
+    RangeSummary summary;
+    a = std::max(a, header_.lo);
+    b = std::min(b, header_.hi);
+    if (a > b) {
+        return summary;
+    }
+    // the leaves the range covers whole, as far as the index has them
+    const uint64_t leafSize = 1ull << header_.leafBits;
+    auto leafLo = [&](uint64_t leaf) { return std::max(header_.lo, (header_.firstLeaf + leaf) << header_.leafBits); };
+    auto leafHi = [&](uint64_t leaf) { return std::min(header_.hi, ((header_.firstLeaf + leaf) << header_.leafBits) + (leafSize - 1)); };
+    const uint64_t firstLeaf = (a >> header_.leafBits) - header_.firstLeaf;
+    const uint64_t lastLeaf = (b >> header_.leafBits) - header_.firstLeaf;
+    uint64_t begin = leafLo(firstLeaf) == a ? firstLeaf : firstLeaf + 1;
+    uint64_t end = leafHi(lastLeaf) == b ? lastLeaf + 1 : lastLeaf;
+
+    std::vector<std::pair<uint64_t, uint64_t>> edges;
+    if (begin > firstLeaf) {
+        edges.emplace_back(a, std::min(b, leafHi(firstLeaf)));
+    }
+    if (end <= lastLeaf && (lastLeaf != firstLeaf || begin == firstLeaf)) {
+        edges.emplace_back(std::max(a, leafLo(lastLeaf)), b);
+    }
+    SweepOptions options;
+    options.rules = header_.GetRules();
+    for (const auto& edge : edges) {
+        std::vector<GameResults> played;
+        std::vector<uint64_t> missing;
+        GameResults gameResults;
+        for (uint64_t n = edge.first; n <= edge.second; n++) {
+            if (results != nullptr && results->GetHeader().GetRules() == options.rules && results->Lookup(n, &gameResults)) {
+                summary.AddRun(gameResults);
+            } else {
+                missing.push_back(n);
+            }
+        }
+        for (size_t begin = 0; begin < missing.size(); ) {
+            // played in runs of consecutive values, the way a sweep chunk is
+            size_t end = begin + 1;
+            while (end < missing.size() && missing[end] == missing[end - 1] + 1) {
+                end++;
+            }
+            PlaySweepChunk(missing[begin], missing[end - 1], options, &played);
+            for (const GameResults& playedResults : played) {
+                summary.AddRun(playedResults);
+            }
+            begin = end;
+        }
+        if (gamesPlayed != nullptr) {
+            *gamesPlayed += missing.size();
+        }
+    }
+
+    // each level takes the nodes up to the next multiple of the fanout from either end, the rest moves up
+    // at the last node of a level the parent sums the same nodes, even when there are fewer than fanout of them
+    for (int level = 0; begin < end; level++) {
+        const bool top = level + 1 == levelsCount_;
+        while (begin < end && (top || begin % header_.fanout != 0)) {
+            level == 0 ? MergeNode<uint32_t>(level, begin, &summary) : MergeNode<uint64_t>(level, begin, &summary);
+            begin++;
+        }
+        while (begin < end && end % header_.fanout != 0 && end != header_.GetNodeCount(level)) {
+            end--;
+            level == 0 ? MergeNode<uint32_t>(level, end, &summary) : MergeNode<uint64_t>(level, end, &summary);
+        }
+        if (begin >= end) {
+            break;
+        }
+        begin /= header_.fanout;
+        end = (end + header_.fanout - 1) / header_.fanout;
+    }
+    return summary;
+}
+
+// query engine ///////////////////////////////////////////////////////////////////////////////////
+
+// The calls other programs make about start values, under the default rules. Start values a results
+// file covers are read from it and the rest are played. Not thread safe, it keeps one pool warm.
+class QueryEngine {
+public:
+    explicit QueryEngine(unsigned threadCount = 0) : pool_(threadCount) {}
+    // The file must hold games of the default rules.
+    bool OpenResults(const std::string& path);
+
+    // results[i] is the game of startValues[i].
+    void PlayBatch(const uint64_t* startValues, size_t count, GameResults* results);
+    OverallStats GetRangeStats(uint64_t lo, uint64_t hi);
+    // Up to count winning start values in [lo, hi], largest first.
+    std::vector<uint64_t> GetLargestWinners(uint64_t lo, uint64_t hi, size_t count);
+    // How many start values in [lo, hi] the results file does not cover, so a range query plays them.
+    uint64_t GetPlayedCount(uint64_t lo, uint64_t hi) const;
+private:
+    // The part of [lo, hi] the results file covers, false if there is none.
+    bool GetStoredRange(uint64_t lo, uint64_t hi, uint64_t* storedLo, uint64_t* storedHi) const;
+    GameResults LookupOrPlay(uint64_t startValue) const;
+
+    WorkStealingPool pool_;
+    std::unique_ptr<ResultsFileReader> results_;
+};
+
+bool QueryEngine::OpenResults(const std::string& path) {
+    std::unique_ptr<ResultsFileReader> results(new ResultsFileReader());
+    if (!results->Open(path) || !results->GetHeader().HasCurrentRules()) {
+        return false;
+    }
+    results_ = std::move(results);
+    return true;
+}
+
+bool QueryEngine::GetStoredRange(uint64_t lo, uint64_t hi, uint64_t* storedLo, uint64_t* storedHi) const {
+    if (!results_) {
+        return false;
+    }
+    *storedLo = std::max(lo, results_->GetHeader().lo);
+    *storedHi = std::min(hi, results_->GetHeader().hi);
+    return *storedLo <= *storedHi;
+}
+
+uint64_t QueryEngine::GetPlayedCount(uint64_t lo, uint64_t hi) const {
+    uint64_t storedLo;
+    uint64_t storedHi;
+    if (!GetStoredRange(lo, hi, &storedLo, &storedHi)) {
+        return hi - lo + 1;
+    }
+    return (storedLo - lo) + (hi - storedHi);
+}
+
+GameResults QueryEngine::LookupOrPlay(uint64_t startValue) const {
+    GameResults results;
+    if (!results_ || !results_->Lookup(startValue, &results)) {
+        results = Play(startValue);
+    }
+    return results;
+}
+
+void QueryEngine::PlayBatch(const uint64_t* startValues, size_t count, GameResults* results) {
+    std::vector<uint64_t> missedValues;
+    std::vector<size_t> missedIndices;
+    for (size_t i = 0; i < count; i++) {
+        if (!results_ || !results_->Lookup(startValues[i], &results[i])) {
+            missedValues.push_back(startValues[i]);
+            missedIndices.push_back(i);
+        }
+    }
+    const size_t chunkSize = 1 << 12;
+    std::vector<GameResults> played(missedValues.size());
+    pool_.Run((missedValues.size() + chunkSize - 1) / chunkSize, [&](unsigned, uint64_t chunk) {
+        size_t begin = chunk * chunkSize;
+        ::PlayBatch(missedValues.data() + begin, std::min(chunkSize, missedValues.size() - begin), played.data() + begin);
+    });
+    for (size_t i = 0; i < played.size(); i++) {
+        results[missedIndices[i]] = played[i];
+    }
+}
+
+OverallStats QueryEngine::GetRangeStats(uint64_t lo, uint64_t hi) {
+    SweepOptions options;
+    options.threadCount = pool_.GetThreadCount();
+    uint64_t storedLo;
+    uint64_t storedHi;
+    if (!GetStoredRange(lo, hi, &storedLo, &storedHi)) {
+        return SweepStats(lo, hi, options);
+    }
+    struct alignas(64) PaddedStats {
+        OverallStats stats;
+    };
+    std::vector<PaddedStats> perThreadStats(pool_.GetThreadCount());
+    SweepChunks(storedLo, storedHi, options, [&](unsigned worker, uint64_t chunkLo, uint64_t chunkHi) {
+        for (uint64_t n = chunkLo; n <= chunkHi; n++) {
+            perThreadStats[worker].stats.AddRun(LookupOrPlay(n));
+        }
+    }, pool_);
+    OverallStats stats;
+    for (const auto& threadStats : perThreadStats) {
+        stats.Merge(threadStats.stats);
+    }
+    if (storedLo > lo) {
+        stats.Merge(SweepStats(lo, storedLo - 1, options));
+    }
+    if (storedHi < hi) {
+        stats.Merge(SweepStats(storedHi + 1, hi, options));
+    }
+    return stats;
+}
+
+std::vector<uint64_t> QueryEngine::GetLargestWinners(uint64_t lo, uint64_t hi, size_t count) {
+    std::vector<uint64_t> winners;
+    WinnerSearchOptions options;
+    options.threadCount = pool_.GetThreadCount();
+    auto addPlayed = [&](uint64_t playedLo, uint64_t playedHi) {
+        if (playedLo <= playedHi && winners.size() < count) {
+            std::vector<uint64_t> played = FindLargestWinners(playedLo, playedHi, count - winners.size(), options);
+            winners.insert(winners.end(), played.begin(), played.end());
+        }
+    };
+    uint64_t storedLo;
+    uint64_t storedHi;
+    if (!GetStoredRange(lo, hi, &storedLo, &storedHi)) {
+        addPlayed(lo, hi);
+        return winners;
+    }
+    if (storedHi < hi) {
+        addPlayed(storedHi + 1, hi);
+    }
+    for (uint64_t n = storedHi; winners.size() < count; n--) {
+        if (LookupOrPlay(n).outcome == GameOutcome::finished) {
+            winners.push_back(n);
+        }
+        if (n == storedLo) {
+            break;
+        }
+    }
+    if (storedLo > lo) {
+        addPlayed(lo, storedLo - 1);
+    }
+    return winners;
+}
+
+// query daemon ///////////////////////////////////////////////////////////////////////////////////
+
+// Frames in both directions are a QueryFrameHeader followed by payloadSize bytes, in host byte order:
+//   play              uint64 startValues[]    -> QueryGameRecord[]
+//   rangeStats        uint64 lo, hi           -> the OverallStats serialization
+//   largestWinners    uint64 lo, hi, count    -> uint64 winners[], largest first
+// A response carries the type and id of its request. A malformed request gets a nonzero status and no payload,
+// and so does a play request of more than MaxQueryPlayValues start values, or a range query over more than
+// MaxQueryRangeValues start values or that would play more than MaxQueryPlayedValues the results file does
+// not cover, since the server answers them on its poll thread.
+enum class QueryType : uint16_t { play = 1, rangeStats = 2, largestWinners = 3 };
+
+struct QueryFrameHeader {
+    uint16_t type = 0;
+    uint16_t status = 0;
+    uint32_t payloadSize = 0;
+    uint64_t requestId = 0;
+};
+static_assert(sizeof(QueryFrameHeader) == 16, "the header is part of the protocol");
+
+struct QueryGameRecord {
+    uint64_t startValue = 0;
+    uint64_t finalValue = UINT64_MAX;   // digits << 4 | fractionDigits, all ones for games without one
+    uint16_t stepsCount = 0;
+    uint16_t cycleLength = 0;
+    uint8_t outcome = 0;
+    uint8_t reserved[3] = {};
+
+    static QueryGameRecord FromResults(const GameResults& results) {
+        QueryGameRecord record;
+        record.startValue = results.startValue;
+        if (results.finalValue) {
+            record.finalValue = results.finalValue->digits << 4 | static_cast<uint64_t>(results.finalValue->fractionDigits);
+        }
+        record.stepsCount = static_cast<uint16_t>(results.stepsCount);
+        record.cycleLength = static_cast<uint16_t>(results.cycleLength);
+        record.outcome = static_cast<uint8_t>(results.outcome);
+        return record;
+    }
+    GameResults ToResults() const {
+        GameResults results(startValue, static_cast<GameOutcome>(outcome), stepsCount, std::nullopt);
+        if (finalValue != UINT64_MAX) {
+            results.finalValue = CalculatorState{ finalValue >> 4, static_cast<int>(finalValue & 0xF) };
+        }
+        if (results.outcome == GameOutcome::cycle) {
+            results.cycleLength = cycleLength;
+            results.cycleEntryStep = stepsCount - cycleLength;
+        }
+        return results;
+    }
+};
+static_assert(sizeof(QueryGameRecord) == 24, "the record is part of the protocol");
+
+constexpr uint32_t MaxQueryPayloadSize = 1 << 24;
+constexpr uint64_t MaxQueryWinners = 1 << 16;
+constexpr uint64_t MaxQueryPlayedValues = 1 << 20;
+// so that the reply to a play request fits in one frame
+constexpr uint64_t MaxQueryPlayValues = std::min<uint64_t>(MaxQueryPayloadSize / sizeof(QueryGameRecord), MaxQueryPlayedValues);
+// stored games are read one by one, so the covered part of a range is bounded too
+constexpr uint64_t MaxQueryRangeValues = 1 << 24;
+
+// Whether a range query over [lo, hi] is small enough to answer on the poll thread.
+bool IsServableQueryRange(const QueryEngine& engine, uint64_t lo, uint64_t hi) {
+    return lo <= hi && hi - lo < MaxQueryRangeValues && engine.GetPlayedCount(lo, hi) <= MaxQueryPlayedValues;
+}
+
+#ifndef _WIN32
+#ifdef MSG_NOSIGNAL
+constexpr int QuerySendFlags = MSG_NOSIGNAL;
+#else
+constexpr int QuerySendFlags = 0;
+#endif
+
+bool MakeUnixSocketAddress(const std::string& path, sockaddr_un* address) {
+    if (path.empty() || path.size() >= sizeof(address->sun_path)) {
+        return false;
+    }
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    memcpy(address->sun_path, path.c_str(), path.size());
+    return true;
+}
+
+// Serves an engine on a Unix domain socket from one poll loop. Each round reads every complete
+// request that has arrived on any connection, plays the start values of all its play requests as
+// one batch, answers its range queries, and then writes back what the sockets take.
+class QueryServer {
+public:
+    explicit QueryServer(QueryEngine& engine) : engine_(engine) {}
+    QueryServer(const QueryServer&) = delete;
+    QueryServer& operator=(const QueryServer&) = delete;
+    ~QueryServer();
+    bool Listen(const std::string& path);
+    // Serves until Stop, which may be called from another thread or a signal handler.
+    void Run();
+    void Stop() { stopping_ = true; }
+
+    uint64_t GetBatchesPlayed() const { return batchesPlayed_; }
+private:
+    struct Connection {
+        int fd = -1;
+        bool closed = false;
+        std::vector<uint8_t> input;
+        std::vector<uint8_t> output;
+    };
+    struct Request {
+        Connection* connection;
+        QueryFrameHeader header;
+        std::vector<uint8_t> payload;
+    };
+    void Read(Connection& connection, std::vector<Request>* requests);
+    void Answer(std::vector<Request>& requests);
+    static bool IsValidPlayRequest(const Request& request);
+    static void Respond(Connection& connection, const QueryFrameHeader& request, uint16_t status, const void* payload, size_t size);
+    static void Write(Connection& connection);
+
+    QueryEngine& engine_;
+    int listenFd_ = -1;
+    std::string path_;
+    std::atomic<bool> stopping_{ false };
+    std::vector<std::unique_ptr<Connection>> connections_;
+    uint64_t batchesPlayed_ = 0;
+};
+
+QueryServer::~QueryServer() {
+    for (auto& connection : connections_) {
+        close(connection->fd);
+    }
+    if (listenFd_ >= 0) {
+        close(listenFd_);
+        unlink(path_.c_str());
+    }
+}
+
+bool QueryServer::Listen(const std::string& path) {
+    sockaddr_un address;
+    if (!MakeUnixSocketAddress(path, &address)) {
+        return false;
+    }
+    listenFd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenFd_ < 0) {
+        return false;
+    }
+    unlink(path.c_str());
+    if (bind(listenFd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listenFd_, 64) != 0
+        || fcntl(listenFd_, F_SETFL, O_NONBLOCK) != 0) {
+        close(listenFd_);
+        listenFd_ = -1;
+        return false;
+    }
+    path_ = path;
+    return true;
+}
+
+void QueryServer::Run() {
+    std::vector<pollfd> fds;
+    while (!stopping_) {
+        fds.assign(1, pollfd{ listenFd_, POLLIN, 0 });
+        for (const auto& connection : connections_) {
+            fds.push_back(pollfd{ connection->fd, static_cast<short>(connection->output.empty() ? POLLIN : POLLIN | POLLOUT), 0 });
+        }
+        // wakes up now and then to see Stop
+        if (poll(fds.data(), fds.size(), 100) <= 0) {
+            continue;
+        }
+        std::vector<Request> requests;
+        for (size_t i = 0; i < connections_.size(); i++) {
+            if (fds[i + 1].revents & (POLLIN | POLLHUP | POLLERR)) {
+                Read(*connections_[i], &requests);
+            }
+        }
+        Answer(requests);
+        for (auto& connection : connections_) {
+            Write(*connection);
+        }
+        connections_.erase(std::remove_if(connections_.begin(), connections_.end(), [](const std::unique_ptr<Connection>& connection) {
+            if (connection->closed) {
+                close(connection->fd);
+            }
+            return connection->closed;
+        }), connections_.end());
+
+        if (fds[0].revents & POLLIN) {
+            for (int fd = accept(listenFd_, nullptr, nullptr); fd >= 0; fd = accept(listenFd_, nullptr, nullptr)) {
+                fcntl(fd, F_SETFL, O_NONBLOCK);
+                connections_.emplace_back(new Connection());
+                connections_.back()->fd = fd;
+            }
+        }
+    }
+}
+
+void QueryServer::Read(Connection& connection, std::vector<Request>* requests) {
+    uint8_t buffer[1 << 16];
+    for (;;) {
+        ssize_t received = recv(connection.fd, buffer, sizeof(buffer), 0);
+        if (received > 0) {
+            connection.input.insert(connection.input.end(), buffer, buffer + received);
+            continue;
+        }
+        if (received == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+            connection.closed = true;
+        }
+        if (received == 0 || errno != EINTR) {
+            break;
+        }
+    }
+    size_t consumed = 0;
+    QueryFrameHeader header;
+    while (connection.input.size() - consumed >= sizeof(header)) {
+        memcpy(&header, connection.input.data() + consumed, sizeof(header));
+        if (header.payloadSize > MaxQueryPayloadSize) {
+            // the stream cannot be trusted past a frame this large
+            connection.closed = true;
+            break;
+        }
+        if (connection.input.size() - consumed - sizeof(header) < header.payloadSize) {
+            break;
+        }
+        const uint8_t* payload = connection.input.data() + consumed + sizeof(header);
+        requests->push_back(Request{ &connection, header, std::vector<uint8_t>(payload, payload + header.payloadSize) });
+        consumed += sizeof(header) + header.payloadSize;
+    }
+    connection.input.erase(connection.input.begin(), connection.input.begin() + consumed);
+}
+
+bool QueryServer::IsValidPlayRequest(const Request& request) {
+    return request.header.type == static_cast<uint16_t>(QueryType::play) && request.payload.size() % sizeof(uint64_t) == 0
+        && request.payload.size() / sizeof(uint64_t) <= MaxQueryPlayValues;
+}
+
+void QueryServer::Answer(std::vector<Request>& requests) {
+    std::vector<uint64_t> startValues;
+    for (const Request& request : requests) {
+        if (IsValidPlayRequest(request)) {
+            size_t count = request.payload.size() / sizeof(uint64_t);
+            startValues.resize(startValues.size() + count);
+            memcpy(startValues.data() + startValues.size() - count, request.payload.data(), request.payload.size());
+        }
+    }
+    std::vector<GameResults> results(startValues.size());
+    if (!startValues.empty()) {
+        engine_.PlayBatch(startValues.data(), startValues.size(), results.data());
+        batchesPlayed_++;
+    }
+
+    size_t nextResult = 0;
+    for (const Request& request : requests) {
+        uint64_t arguments[3] = {};
+        if (!request.payload.empty()) {
+            memcpy(arguments, request.payload.data(), std::min(request.payload.size(), sizeof(arguments)));
+        }
+        const uint64_t lo = arguments[0];
+        const uint64_t hi = std::min(arguments[1], MaxCalculatorIntValue);
+        switch (static_cast<QueryType>(request.header.type)) {
+            case QueryType::play:
+                if (IsValidPlayRequest(request)) {
+                    std::vector<QueryGameRecord> records;
+                    for (size_t i = 0; i < request.payload.size() / sizeof(uint64_t); i++) {
+                        records.push_back(QueryGameRecord::FromResults(results[nextResult++]));
+                    }
+                    Respond(*request.connection, request.header, 0, records.data(), records.size() * sizeof(QueryGameRecord));
+                    continue;
+                }
+                break;
+            case QueryType::rangeStats:
+                if (request.payload.size() == 2 * sizeof(uint64_t) && IsServableQueryRange(engine_, lo, hi)) {
+                    std::ostringstream out;
+                    engine_.GetRangeStats(lo, hi).Serialize(out);
+                    const std::string text = out.str();
+                    Respond(*request.connection, request.header, 0, text.data(), text.size());
+                    continue;
+                }
+                break;
+            case QueryType::largestWinners:
+                if (request.payload.size() == 3 * sizeof(uint64_t) && arguments[2] <= MaxQueryWinners
+                    && IsServableQueryRange(engine_, lo, hi)) {
+                    std::vector<uint64_t> winners = engine_.GetLargestWinners(lo, hi, static_cast<size_t>(arguments[2]));
+                    Respond(*request.connection, request.header, 0, winners.data(), winners.size() * sizeof(uint64_t));
+                    continue;
+                }
+                break;
+        }
+        Respond(*request.connection, request.header, 1, nullptr, 0);
+    }
+}
+
+void QueryServer::Respond(Connection& connection, const QueryFrameHeader& request, uint16_t status, const void* payload, size_t size) {
+    QueryFrameHeader header = request;
+    header.status = status;
+    header.payloadSize = static_cast<uint32_t>(size);
+    const uint8_t* headerBytes = reinterpret_cast<const uint8_t*>(&header);
+    connection.output.insert(connection.output.end(), headerBytes, headerBytes + sizeof(header));
+    connection.output.insert(connection.output.end(), static_cast<const uint8_t*>(payload), static_cast<const uint8_t*>(payload) + size);
+}
+
+void QueryServer::Write(Connection& connection) {
+    size_t sent = 0;
+    while (sent < connection.output.size()) {
+        ssize_t written = send(connection.fd, connection.output.data() + sent, connection.output.size() - sent, QuerySendFlags);
+        if (written > 0) {
+            sent += written;
+        } else if (written < 0 && errno == EINTR) {
+            continue;
+        } else {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                connection.closed = true;
+            }
+            break;
+        }
+    }
+    connection.output.erase(connection.output.begin(), connection.output.begin() + sent);
+}
+
+// A blocking client of QueryServer with one request in flight.
+class QueryClient {
+public:
+    QueryClient() = default;
+    QueryClient(const QueryClient&) = delete;
+    QueryClient& operator=(const QueryClient&) = delete;
+    ~QueryClient() { Close(); }
+    bool Connect(const std::string& path);
+    void Close();
+
+    bool Play(const uint64_t* startValues, size_t count, std::vector<GameResults>* results);
+    bool GetRangeStats(uint64_t lo, uint64_t hi, OverallStats* stats);
+    bool GetLargestWinners(uint64_t lo, uint64_t hi, size_t count, std::vector<uint64_t>* winners);
+private:
+    // False when the server cannot be reached or rejects the request.
+    bool Call(QueryType type, const void* payload, size_t size, std::vector<uint8_t>* response);
+
+    int fd_ = -1;
+    uint64_t nextRequestId_ = 1;
+};
+
+bool QueryClient::Connect(const std::string& path) {
+    sockaddr_un address;
+    if (!MakeUnixSocketAddress(path, &address)) {
+        return false;
+    }
+    Close();
+    fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd_ < 0 || connect(fd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+void QueryClient::Close() {
+    if (fd_ >= 0) {
+        close(fd_);
+        fd_ = -1;
+    }
+}
+
+bool QueryClient::Call(QueryType type, const void* payload, size_t size, std::vector<uint8_t>* response) {
+    if (fd_ < 0 || size > MaxQueryPayloadSize) {
+        return false;
+    }
+    QueryFrameHeader header;
+    header.type = static_cast<uint16_t>(type);
+    header.payloadSize = static_cast<uint32_t>(size);
+    header.requestId = nextRequestId_++;
+    std::vector<uint8_t> frame(sizeof(header) + size);
+    memcpy(frame.data(), &header, sizeof(header));
+    memcpy(frame.data() + sizeof(header), payload, size);
+    auto transfer = [this](uint8_t* data, size_t size, bool sending) {
+        while (size > 0) {
+            ssize_t count = sending ? send(fd_, data, size, QuerySendFlags) : recv(fd_, data, size, 0);
+            if (count < 0 && errno == EINTR) {
+                continue;
+            }
+            if (count <= 0) {
+                return false;
+            }
+            data += count;
+            size -= count;
+        }
+        return true;
+    };
+    QueryFrameHeader reply;
+    if (!transfer(frame.data(), frame.size(), true) || !transfer(reinterpret_cast<uint8_t*>(&reply), sizeof(reply), false)
+        || reply.requestId != header.requestId || reply.payloadSize > MaxQueryPayloadSize) {
+        Close();
+        return false;
+    }
+    response->resize(reply.payloadSize);
+    if (!transfer(response->data(), response->size(), false)) {
+        Close();
+        return false;
+    }
+    return reply.status == 0;
+}
+
+bool QueryClient::Play(const uint64_t* startValues, size_t count, std::vector<GameResults>* results) {
+    std::vector<uint8_t> response;
+    if (!Call(QueryType::play, startValues, count * sizeof(uint64_t), &response) || response.size() != count * sizeof(QueryGameRecord)) {
+        return false;
+    }
+    results->resize(count);
+    for (size_t i = 0; i < count; i++) {
+        QueryGameRecord record;
+        memcpy(&record, response.data() + i * sizeof(record), sizeof(record));
+        (*results)[i] = record.ToResults();
+    }
+    return true;
+}
+
+bool QueryClient::GetRangeStats(uint64_t lo, uint64_t hi, OverallStats* stats) {
+    const uint64_t arguments[2] = { lo, hi };
+    std::vector<uint8_t> response;
+    if (!Call(QueryType::rangeStats, arguments, sizeof(arguments), &response)) {
+        return false;
+    }
+    std::istringstream in(std::string(response.begin(), response.end()));
+    *stats = OverallStats();
+    return stats->Deserialize(in);
+}
+
+bool QueryClient::GetLargestWinners(uint64_t lo, uint64_t hi, size_t count, std::vector<uint64_t>* winners) {
+    const uint64_t arguments[3] = { lo, hi, count };
+    std::vector<uint8_t> response;
+    if (!Call(QueryType::largestWinners, arguments, sizeof(arguments), &response) || response.size() % sizeof(uint64_t) != 0) {
+        return false;
+    }
+    winners->resize(response.size() / sizeof(uint64_t));
+    memcpy(winners->data(), response.data(), response.size());
+    return true;
+}
+#endif
+
+// trajectory export //////////////////////////////////////////////////////////////////////////////
+
+// One line per game: start value, outcome and steps, then every recorded state followed by the rule that
+// moved it on, s for a suffix divisor, r for the repeating digits rule and m for a fraction multiplier,
+// with that divisor or multiplier. "9922 finished 2: 9922 r22 451 s51 8.843137254"
+void WriteTrajectory(std::ostream& out, const GameResults& results, const TrajectoryRecorder& recorder) {
+    out << results.startValue << ' ' << OverallStats::ToString(results.outcome) << ' ' << results.stepsCount << ':';
+    for (size_t i = 0; i < recorder.GetStepsCount(); i++) {
+        const TrajectoryStep& step = recorder.GetSteps()[i];
+        out << ' ' << step.GetState().ToString();
+        switch (step.rule) {
+            case StepRule::suffixDivisor: out << " s" << step.operand; break;
+            case StepRule::repeatingDigits: out << " r" << step.operand; break;
+            case StepRule::fractionMultiplier: out << " m" << step.operand; break;
+            case StepRule::none: break;
+        }
+    }
+    if (recorder.IsTruncated()) {
+        out << " ...";
+    }
+    out << '\n';
+}
+
+// Plays [lo, hi] with a recorder per worker and writes the trajectories of the games select picks, in order.
+void WriteTrajectories(std::ostream& out, uint64_t lo, uint64_t hi, const std::function<bool(const GameResults&)>& select,
+    unsigned threadCount = 0) {
+    SweepOptions options;
+    options.chunkSize = 1 << 12;
+    WorkStealingPool pool(threadCount);
+    std::vector<std::unique_ptr<TrajectoryRecorder>> recorders;
+    for (unsigned worker = 0; worker < pool.GetThreadCount(); worker++) {
+        recorders.emplace_back(new TrajectoryRecorder());
+    }
+    std::vector<std::string> chunkTexts(lo > hi ? 0 : (hi - lo) / options.chunkSize + 1);
+    SweepChunks(lo, hi, options, [&](unsigned worker, uint64_t chunkLo, uint64_t chunkHi) {
+        std::ostringstream text;
+        for (uint64_t n = chunkLo; n <= chunkHi; n++) {
+            GameResults results = Play(n, nullptr, recorders[worker].get());
+            if (select(results)) {
+                WriteTrajectory(text, results, *recorders[worker]);
+            }
+        }
+        chunkTexts[(chunkLo - lo) / options.chunkSize] = text.str();
+    }, pool);
+    for (const std::string& text : chunkTexts) {
+        out << text;
+    }
+}
+
+// reference play /////////////////////////////////////////////////////////////////////////////////
+
+// A frozen copy of Play and its step functions under the default rules, with the digit loops the tables
+// replaced and without the cache or the small value table. The differential harness checks every engine,
+// Play included, against it, so it changes only when the rules of the game do.
+constexpr int ReferenceDigits = 10;
+constexpr uint64_t ReferenceMaxIntValue = 9999999999;
+constexpr int ReferenceMaxMoves = 1000;
+static_assert(DefaultRules::Digits == ReferenceDigits && DefaultRules::MaxIntValue == ReferenceMaxIntValue
+    && DefaultRules::RepeatingDigitsRule && DefaultRules::MaxMoves == ReferenceMaxMoves,
+    "the reference plays the default rules");
+
+int ReferenceDigitsCount(uint64_t value) {
+    int digits = 1;
+    while (value >= 10) {
+        value /= 10;
+        digits++;
+    }
+    return digits;
+}
+
+bool ReferenceHasTwoRepeatingDigits(const uint64_t num, uint64_t* valueAfterTwoRepeatingDigits) {
+    *valueAfterTwoRepeatingDigits = 0;
+    if (num < 1000 || num > ReferenceMaxIntValue) {
+        return false;
+    }
+    uint64_t multipler = 1;
+    while (multipler * 10 < num) {
+        multipler *= 10;
+    }
+    uint64_t truncatedNum = num;
+    std::optional<uint64_t> prevDigit = std::nullopt;
+    while (multipler > 1) {
+        uint64_t digit = truncatedNum / multipler;
+        if (prevDigit && *prevDigit == digit) {
+            *valueAfterTwoRepeatingDigits = num % multipler;
+            return *valueAfterTwoRepeatingDigits > 1;
+        }
+        prevDigit = std::optional<uint64_t>{ digit };
+        truncatedNum -= digit * multipler;
+        multipler /= 10;
+    }
+    return false;
+}
+
+uint64_t ReferenceSuffixDivisor(const uint64_t n) {
+    uint64_t num = n;
+    uint64_t divideBy = 0;
+    uint64_t multiplier = 1;
+    while ((divideBy == 0 || divideBy == 1) && divideBy < n) {
+        divideBy += num % 10 * multiplier;
+        num /= 10;
+        multiplier *= 10;
+    }
+    return divideBy;
+}
+
+CalculatorState ReferenceDivide(const uint64_t dividend, const uint64_t divisor) {
+    uint64_t quotient = dividend / divisor;
+    uint64_t remainder = dividend % divisor;
+    int fractionDigits = ReferenceDigits - ReferenceDigitsCount(quotient);
+    uint64_t scale = PowersOfTen[fractionDigits];
+    return CalculatorState::FromDisplay(quotient * scale + remainder * scale / divisor, fractionDigits);
+}
+
+CalculatorState ReferenceMultiply(const CalculatorState& n, const uint64_t multiplier) {
+    uint64_t intPart = n.GetIntPart();
+    if (intPart != 0 && multiplier > ReferenceMaxIntValue / intPart) {
+        return CalculatorState::Overflow();
+    }
+    uint64_t scale = PowersOfTen[n.fractionDigits];
+    uint64_t scaledFraction = n.GetFractionPart() * multiplier;
+    uint64_t productIntPart = intPart * multiplier + scaledFraction / scale;
+    uint64_t productFraction = scaledFraction % scale;
+    if (productIntPart > ReferenceMaxIntValue || (productIntPart == ReferenceMaxIntValue && productFraction != 0)) {
+        return CalculatorState::Overflow();
+    }
+    int fractionDigits = std::min(n.fractionDigits, ReferenceDigits - ReferenceDigitsCount(productIntPart));
+    uint64_t truncatedFraction = productFraction / PowersOfTen[n.fractionDigits - fractionDigits];
+    return CalculatorState::FromDisplay(productIntPart * PowersOfTen[fractionDigits] + truncatedFraction, fractionDigits);
+}
+
+uint64_t ReferenceFractionMultiplier(const CalculatorState& n) {
+    uint64_t intPart = n.GetIntPart();
+    uint64_t fractionPart = n.GetFractionPart();
+    int fractPartLeadingZerosCount = fractionPart == 0 ? 0 : n.fractionDigits - ReferenceDigitsCount(fractionPart);
+    uint64_t multipler = fractionPart;
+    uint64_t exponent = 1;
+    while (fractPartLeadingZerosCount-- > 0) {
+        exponent *= 10;
+    }
+    while (multipler < 2) {
+        exponent *= 10;
+        multipler += exponent * (intPart % 10);
+        intPart /= 10;
+    }
+    return multipler;
+}
+
+CalculatorState ReferenceNextStep(const CalculatorState& n) {
+    if (n.IsInteger()) {
+        if (n.digits < 10) {
+            return n;
+        }
+        uint64_t valueAfterTwoRepeatingDigits = 0;
+        bool hasTwoRepeatingDigits = ReferenceHasTwoRepeatingDigits(n.digits, &valueAfterTwoRepeatingDigits);
+        if (hasTwoRepeatingDigits && valueAfterTwoRepeatingDigits != 0) {
+            return ReferenceDivide(n.digits, valueAfterTwoRepeatingDigits);
+        }
+        return ReferenceDivide(n.digits, ReferenceSuffixDivisor(n.digits));
+    }
+    if (n.GetIntPart() < 10 || n.IsOverflow()) {
+        return n;
+    }
+    return ReferenceMultiply(n, ReferenceFractionMultiplier(n));
+}
+
+void ReferenceFindCycleEntry(uint64_t num, int cycleLength, GameResults* results) {
+    CalculatorState entry = CalculatorState::FromInt(num, ReferenceMaxIntValue);
+    CalculatorState ahead = entry;
+    for (int i = 0; i < cycleLength; i++) {
+        ahead = ReferenceNextStep(ahead);
+    }
+    int entryStep = 0;
+    while (entry != ahead) {
+        entry = ReferenceNextStep(entry);
+        ahead = ReferenceNextStep(ahead);
+        entryStep++;
+    }
+    results->outcome = GameOutcome::cycle;
+    results->stepsCount = entryStep + cycleLength;
+    results->finalValue = std::optional<CalculatorState>{ entry };
+    results->cycleEntryStep = entryStep;
+    results->cycleLength = cycleLength;
+}
+
+GameResults ReferencePlay(uint64_t num) {
+    GameResults results;
+    results.startValue = num;
+    CalculatorState n = CalculatorState::FromInt(num, ReferenceMaxIntValue);
+    // Brent's cycle detection, the tortoise jumps to the current state every power of two steps
+    CalculatorState tortoise = n;
+    int power = 1;
+    int lambda = 0;
+    for (int moves = 0; moves < ReferenceMaxMoves; moves++) {
+        if (n.GetIntPart() < 10) {
+            results.finalValue = std::optional<CalculatorState>{ n };
+            results.outcome = GameOutcome::finished;
+            break;
+        }
+        if (n.IsOverflow()) {
+            results.outcome = GameOutcome::overflow;
+            break;
+        }
+        if (moves > 0 && n == tortoise) {
+            ReferenceFindCycleEntry(num, lambda, &results);
+            break;
+        }
+        if (power == lambda) {
+            tortoise = n;
+            power *= 2;
+            lambda = 0;
+        }
+        results.stepsCount++;
+        n = ReferenceNextStep(n);
+        lambda++;
+    }
+    if (results.outcome == GameOutcome::unknown) {
+        results.outcome = GameOutcome::tooManyMoves;
+    }
+    return results;
+}
+
+// differential testing ///////////////////////////////////////////////////////////////////////////
+
+// An engine plays a batch of start values under the default rules; ReferencePlay is what it must match.
+struct DifferentialEngine {
+    std::string name;
+    std::function<void(const uint64_t*, size_t, GameResults*)> play;
+};
+
+// Every way the tree plays a game. The cache is shared by all workers, as a sweep shares it.
+std::vector<DifferentialEngine> GetDifferentialEngines(TrajectoryCache* cache) {
+    std::vector<DifferentialEngine> engines;
+    engines.push_back({ "play", [](const uint64_t* startValues, size_t count, GameResults* results) {
+        for (size_t i = 0; i < count; i++) {
+            results[i] = Play(startValues[i]);
+        }
+    } });
+    engines.push_back({ "batch", PlayBatch });
+    engines.push_back({ "cache", [cache](const uint64_t* startValues, size_t count, GameResults* results) {
+        for (size_t i = 0; i < count; i++) {
+            results[i] = Play(startValues[i], cache);
+        }
+    } });
+    engines.push_back({ "recorder", [](const uint64_t* startValues, size_t count, GameResults* results) {
+        TrajectoryRecorder recorder;
+        for (size_t i = 0; i < count; i++) {
+            results[i] = Play(startValues[i], nullptr, &recorder);
+        }
+    } });
+    return engines;
+}
+
+// Start values at the edges the kernels special-case: digit count boundaries, runs of one digit, repeating pairs
+// next to zeros and at either end, and the values whose first step lands on a fraction like 12.12 or 10.01,
+// where the multiplier has to borrow digits from the int part.
+std::vector<uint64_t> GetDifferentialEdgeValues() {
+    std::vector<uint64_t> values;
+    for (int digits = 2; digits <= DigitsInCalculator; digits++) {
+        const uint64_t low = PowersOfTen[digits - 1];
+        const uint64_t high = PowersOfTen[digits] - 1;
+        for (uint64_t value : { low, low + 1, low + 10, low + low / 10, 2 * low, high, high - 1, high - 10 }) {
+            values.push_back(value);
+        }
+        for (uint64_t digit = 1; digit <= 9; digit++) {
+            values.push_back(high / 9 * digit);
+        }
+        uint64_t alternating = 0;
+        uint64_t pairs = 0;
+        for (int i = 0; i < digits; i++) {
+            alternating = alternating * 10 + (i % 2 == 0 ? 1 : 2);
+            pairs = pairs * 10 + static_cast<uint64_t>(i / 2 % 9 + 1);
+        }
+        values.push_back(alternating);
+        values.push_back(pairs);
+        values.push_back(alternating - alternating % 100);
+        values.push_back(11 * PowersOfTen[digits - 2] + 1);
+        values.push_back(low + 11);
+    }
+    for (int fractionDigits = 1; fractionDigits <= 3; fractionDigits++) {
+        const uint64_t scale = PowersOfTen[fractionDigits];
+        for (uint64_t intPart : { 10, 11, 12, 99 }) {
+            for (uint64_t fraction : { uint64_t(1), 12 % scale, scale - 1 }) {
+                const CalculatorState target = CalculatorState::FromDisplay(intPart * scale + fraction, fractionDigits);
+                for (const CalculatorState& predecessor : FindPredecessors(target)) {
+                    if (predecessor.IsInteger() && predecessor.digits >= 10) {
+                        values.push_back(predecessor.digits);
+                    }
+                }
+            }
+        }
+    }
+    std::sort(values.begin(), values.end());
+    values.erase(std::unique(values.begin(), values.end()), values.end());
+    return values;
+}
+
+struct DifferentialOptions {
+    unsigned threadCount = 0;
+    // every start value in [10, exhaustiveHi]
+    uint64_t exhaustiveHi = 1000000;
+    // seeded random start values with all of the calculator's digits
+    uint64_t randomSamples = 1000000;
+    uint64_t seed = 1;
+    bool edgeValues = true;
+};
+
+struct DifferentialMismatch {
+    std::string engine;
+    GameResults expected;
+    GameResults actual;
+    // the shortest game that still fails: the last int state of the failing game the engine gets wrong
+    GameResults minimizedExpected;
+    GameResults minimizedActual;
+    // the failing game's step at which the minimized game starts
+    int minimizedAtStep = 0;
+};
+
+// Walks the reference trajectory of the failing game from its end and keeps the last int state that the engine
+// gets wrong as a start value, so the report is the shortest game that shows the bug.
+void MinimizeMismatch(const DifferentialEngine& engine, DifferentialMismatch* mismatch) {
+    mismatch->minimizedExpected = mismatch->expected;
+    mismatch->minimizedActual = mismatch->actual;
+    std::vector<CalculatorState> trajectory = { CalculatorState::FromInt(mismatch->expected.startValue) };
+    for (int step = 0; step < mismatch->expected.stepsCount; step++) {
+        trajectory.push_back(ReferenceNextStep(trajectory.back()));
+    }
+    for (size_t step = trajectory.size(); step-- > 1; ) {
+        const CalculatorState state = trajectory[step];
+        if (!state.IsInteger() || state.IsOverflow() || state.digits < 10) {
+            continue;
+        }
+        GameResults expected = ReferencePlay(state.digits);
+        GameResults actual;
+        engine.play(&state.digits, 1, &actual);
+        if (actual != expected) {
+            mismatch->minimizedExpected = expected;
+            mismatch->minimizedActual = actual;
+            mismatch->minimizedAtStep = static_cast<int>(step);
+            return;
+        }
+    }
+}
+
+// Plays every start value of the options' suites with the reference and each engine, in parallel, and stops at
+// the first mismatch. Of the mismatches found before the workers stop, the smallest start value is reported.
+bool RunDifferentialTest(const std::vector<DifferentialEngine>& engines, const DifferentialOptions& options,
+    DifferentialMismatch* mismatch, uint64_t* gamesCompared) {
+    std::vector<uint64_t> startValues;
+    if (options.edgeValues) {
+        startValues = GetDifferentialEdgeValues();
+    }
+    // drawn by multiply-shift, like the sampler, so that a seed gives the same start values everywhere
+    std::mt19937_64 random(options.seed);
+    const uint64_t lowest = PowersOfTen[DigitsInCalculator - 1];
+    for (uint64_t sample = 0; sample < options.randomSamples; sample++) {
+        startValues.push_back(lowest + MulHigh(random(), MaxCalculatorIntValue - lowest + 1));
+    }
+    const uint64_t exhaustiveCount = options.exhaustiveHi >= 10 ? options.exhaustiveHi - 9 : 0;
+    const uint64_t listedCount = startValues.size();
+    const uint64_t totalCount = listedCount + exhaustiveCount;
+
+    const uint64_t chunkSize = 1 << 12;
+    WorkStealingPool pool(options.threadCount);
+    std::atomic<bool> failed(false);
+    std::atomic<uint64_t> compared(0);
+    std::mutex mutex;
+    pool.Run((totalCount + chunkSize - 1) / chunkSize, [&](unsigned, uint64_t chunk) {
+        if (failed.load(std::memory_order_relaxed)) {
+            return;
+        }
+        const uint64_t begin = chunk * chunkSize;
+        const uint64_t count = std::min(chunkSize, totalCount - begin);
+        std::vector<uint64_t> values(count);
+        for (uint64_t i = 0; i < count; i++) {
+            values[i] = begin + i < listedCount ? startValues[begin + i] : begin + i - listedCount + 10;
+        }
+        std::vector<GameResults> expected(count);
+        for (uint64_t i = 0; i < count; i++) {
+            expected[i] = ReferencePlay(values[i]);
+        }
+        std::vector<GameResults> actual(count);
+        for (const DifferentialEngine& engine : engines) {
+            engine.play(values.data(), count, actual.data());
+            for (uint64_t i = 0; i < count; i++) {
+                if (actual[i] == expected[i]) {
+                    continue;
+                }
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!failed || expected[i].startValue < mismatch->expected.startValue) {
+                    mismatch->engine = engine.name;
+                    mismatch->expected = expected[i];
+                    mismatch->actual = actual[i];
+                }
+                failed = true;
+                return;
+            }
+        }
+        compared += count;
+    });
+    *gamesCompared = compared;
+    if (failed) {
+        for (const DifferentialEngine& engine : engines) {
+            if (engine.name == mismatch->engine) {
+                MinimizeMismatch(engine, mismatch);
+            }
+        }
+    }
+    return !failed;
+}
+
+// "4561 overflow 3 steps" or "12 finished 1 steps on 6"; engines under test may return any outcome.
+std::string DescribeGameResults(const GameResults& results) {
+    std::ostringstream text;
+    text << results.startValue << ' '
+        << (results.outcome == GameOutcome::unknown ? std::string("unknown") : OverallStats::ToString(results.outcome))
+        << ' ' << results.stepsCount << " steps";
+    if (results.finalValue) {
+        text << " on " << results.finalValue->ToString();
+    }
+    if (results.outcome == GameOutcome::cycle) {
+        text << " (cycle of " << results.cycleLength << " from step " << results.cycleEntryStep << ")";
+    }
+    return text.str();
+}
+
+// benchmark suite ////////////////////////////////////////////////////////////////////////////////
+
+// keeps benchmarked kernels from being optimized away
+volatile uint64_t BenchSink = 0;
+
+struct BenchmarkResult {
+    std::string name;
+    uint64_t ops = 0;
+    double nsPerOp = 0;
+    double stddevNsPerOp = 0;
+    double minNsPerOp = 0;
+    bool games = false;
+};
+
+struct BenchmarkOptions {
+    size_t setSize = 4096;
+    int repetitions = 10;
+};
+
+// Times kernel over every input, once per repetition, and summarizes the per-op time across repetitions.
+template <typename Input, typename Kernel>
+BenchmarkResult RunBenchmark(const std::string& name, const std::vector<Input>& inputs, int repetitions, Kernel kernel) {
+    BenchmarkResult result;
+    result.name = name;
+    result.ops = inputs.size();
+    if (inputs.empty()) {
+        return result;
+    }
+    std::vector<double> samples;
+    uint64_t checksum = 0;
+    for (int repetition = 0; repetition < repetitions; repetition++) {
+        auto start = std::chrono::steady_clock::now();
+        for (const Input& input : inputs) {
+            checksum += kernel(input);
+        }
+        auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        samples.push_back(elapsed / inputs.size());
+    }
+    BenchSink = checksum;
+    double sum = std::accumulate(samples.begin(), samples.end(), 0.0);
+    result.nsPerOp = sum / samples.size();
+    double squares = 0;
+    for (double sample : samples) {
+        squares += (sample - result.nsPerOp) * (sample - result.nsPerOp);
+    }
+    result.stddevNsPerOp = samples.size() > 1 ? std::sqrt(squares / (samples.size() - 1)) : 0;
+    result.minNsPerOp = *std::min_element(samples.begin(), samples.end());
+    return result;
+}
+
+std::vector<uint64_t> RandomIntsWithDigits(int digits, size_t count, std::mt19937_64& random) {
+    std::uniform_int_distribution<uint64_t> distribution(PowersOfTen[digits - 1], PowersOfTen[digits] - 1);
+    std::vector<uint64_t> values(count);
+    for (uint64_t& n : values) {
+        n = distribution(random);
+    }
+    return values;
+}
+
+// Fractional states as the game produces them, from dividing random integers, bucketed by int part digits.
+std::vector<std::vector<CalculatorState>> FractionalStatesByIntDigits(size_t count, std::mt19937_64& random) {
+    std::vector<std::vector<CalculatorState>> states(DigitsInCalculator);
+    std::uniform_int_distribution<int> digitsDistribution(2, DigitsInCalculator);
+    for (size_t attempts = 0; attempts < count * 1000; attempts++) {
+        int digits = digitsDistribution(random);
+        std::uniform_int_distribution<uint64_t> distribution(PowersOfTen[digits - 1], PowersOfTen[digits] - 1);
+        CalculatorState n = NextStepForInt(distribution(random));
+        if (n.IsInteger() || n.GetIntPart() < 10) {
+            continue;
+        }
+        std::vector<CalculatorState>& bucket = states[DigitsCount(n.GetIntPart())];
+        if (bucket.size() < count) {
+            bucket.push_back(n);
+        }
+    }
+    return states;
+}
+
+// Start values grouped by outcome, collected from the lowest start values up.
+std::map<GameOutcome, std::vector<uint64_t>> StartValuesByOutcome(size_t count) {
+    std::map<GameOutcome, std::vector<uint64_t>> values;
+    constexpr uint64_t Scanned = 200000;
+    std::vector<uint64_t> startValues(Scanned);
+    std::iota(startValues.begin(), startValues.end(), 10);
+    std::vector<GameResults> results(Scanned);
+    PlayBatch(startValues.data(), startValues.size(), results.data());
+    for (const GameResults& result : results) {
+        std::vector<uint64_t>& bucket = values[result.outcome];
+        if (bucket.size() < count) {
+            bucket.push_back(result.startValue);
+        }
+    }
+    return values;
+}
+
+std::vector<BenchmarkResult> RunBenchmarkSuite(const BenchmarkOptions& options) {
+    std::vector<BenchmarkResult> results;
+    std::mt19937_64 random(options.setSize);
+    const int repetitions = options.repetitions;
+    for (int digits = 2; digits <= DigitsInCalculator; digits++) {
+        std::vector<uint64_t> values = RandomIntsWithDigits(digits, options.setSize, random);
+        std::string group = "/digits:" + std::to_string(digits);
+        results.push_back(RunBenchmark("NextStepForInt" + group, values, repetitions,
+            [](uint64_t n) { return NextStepForInt(n).digits; }));
+        results.push_back(RunBenchmark("HasTwoRepeatingDigits" + group, values, repetitions,
+            [](uint64_t n) { uint64_t value; return HasTwoRepeatingDigits(n, &value) + value; }));
+    }
+
+    std::vector<std::vector<CalculatorState>> states = FractionalStatesByIntDigits(options.setSize, random);
+    for (int digits = 2; digits < DigitsInCalculator; digits++) {
+        std::string group = "/intDigits:" + std::to_string(digits);
+        results.push_back(RunBenchmark("NextStepForNonInt" + group, states[digits], repetitions,
+            [](const CalculatorState& n) { return NextStepForNonInt(n).digits; }));
+        results.push_back(RunBenchmark("BreakFractionToIntAndFracPart" + group, states[digits], repetitions,
+            [](const CalculatorState& n) {
+                uint64_t intPart;
+                uint64_t fractionPart;
+                int leadingZeros;
+                BreakFractionToIntAndFracPart(n, &intPart, &fractionPart, &leadingZeros);
+                return intPart + fractionPart + leadingZeros;
+            }));
+    }
+
+    auto play = [](uint64_t n) { return static_cast<uint64_t>(Play(n).stepsCount); };
+    for (int digits = 2; digits <= DigitsInCalculator; digits++) {
+        std::vector<uint64_t> values = RandomIntsWithDigits(digits, options.setSize, random);
+        results.push_back(RunBenchmark("Play/digits:" + std::to_string(digits), values, repetitions, play));
+        results.back().games = true;
+    }
+    for (const auto& outcomeAndValues : StartValuesByOutcome(options.setSize)) {
+        results.push_back(RunBenchmark("Play/outcome:" + OverallStats::ToString(outcomeAndValues.first),
+            outcomeAndValues.second, repetitions, play));
+        results.back().games = true;
+    }
+    results.erase(std::remove_if(results.begin(), results.end(), [](const BenchmarkResult& result) { return result.ops == 0; }),
+        results.end());
+    return results;
+}
+
+void WriteBenchmarkJson(std::ostream& out, const BenchmarkOptions& options, const std::vector<BenchmarkResult>& results) {
+    out << "{\n  \"repetitions\": " << options.repetitions << ",\n  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchmarkResult& result = results[i];
+        out << "    { \"name\": \"" << result.name << "\", \"ops\": " << result.ops
+            << ", \"nsPerOp\": " << result.nsPerOp << ", \"stddevNsPerOp\": " << result.stddevNsPerOp
+            << ", \"minNsPerOp\": " << result.minNsPerOp;
+        if (result.games) {
+            out << ", \"gamesPerSec\": " << 1e9 / result.nsPerOp;
+        }
+        out << " }" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+// Reads back the benchmarks WriteBenchmarkJson wrote, keyed by name.
+bool ReadBenchmarkJson(const std::string& path, std::map<std::string, BenchmarkResult>* results) {
+    std::ifstream in(path);
+    if (!in) {
+        return false;
+    }
+    std::stringstream buffer;
+    buffer << in.rdbuf();
+    const std::string json = buffer.str();
+    auto numberAfter = [&](const std::string& key, size_t from, size_t to) {
+        size_t at = json.find("\"" + key + "\": ", from);
+        return at < to ? std::strtod(json.c_str() + at + key.size() + 4, nullptr) : 0.0;
+    };
+    for (size_t at = json.find("{ \"name\": \""); at != std::string::npos; at = json.find("{ \"name\": \"", at + 1)) {
+        size_t nameBegin = at + 11;
+        size_t end = json.find('}', at);
+        BenchmarkResult result;
+        result.name = json.substr(nameBegin, json.find('"', nameBegin) - nameBegin);
+        result.ops = static_cast<uint64_t>(numberAfter("ops", at, end));
+        result.nsPerOp = numberAfter("nsPerOp", at, end);
+        result.stddevNsPerOp = numberAfter("stddevNsPerOp", at, end);
+        result.minNsPerOp = numberAfter("minNsPerOp", at, end);
+        // a zero or missing time would make every comparison against it pass
+        if (result.ops == 0 || !std::isfinite(result.nsPerOp) || result.nsPerOp <= 0
+            || !std::isfinite(result.stddevNsPerOp) || result.stddevNsPerOp < 0) {
+            return false;
+        }
+        (*results)[result.name] = result;
+    }
+    return true;
+}
+
+// A benchmark regressed when it got slower by more than thresholdPercent and by more than twice the combined noise.
+// Results that are not positive count as regressions, so that a broken measurement cannot pass.
+bool CompareBenchmarks(std::ostream& out, const std::map<std::string, BenchmarkResult>& baseline,
+    const std::map<std::string, BenchmarkResult>& current, double thresholdPercent) {
+    bool regressed = false;
+    for (const auto& nameAndResult : current) {
+        auto base = baseline.find(nameAndResult.first);
+        if (base == baseline.end()) {
+            out << nameAndResult.first << " new " << nameAndResult.second.nsPerOp << " ns/op\n";
+            continue;
+        }
+        const BenchmarkResult& before = base->second;
+        const BenchmarkResult& after = nameAndResult.second;
+        if (!(before.nsPerOp > 0) || !(after.nsPerOp > 0)) {
+            out << nameAndResult.first << " invalid " << before.nsPerOp << " -> " << after.nsPerOp << " ns/op REGRESSION\n";
+            regressed = true;
+            continue;
+        }
+        double change = 100.0 * (after.nsPerOp - before.nsPerOp) / before.nsPerOp;
+        double noise = 2 * std::sqrt(before.stddevNsPerOp * before.stddevNsPerOp + after.stddevNsPerOp * after.stddevNsPerOp);
+        bool isRegression = change > thresholdPercent && after.nsPerOp - before.nsPerOp > noise;
+        regressed |= isRegression;
+        out << nameAndResult.first << " " << before.nsPerOp << " -> " << after.nsPerOp << " ns/op ("
+            << (change >= 0 ? "+" : "") << change << "%)" << (isRegression ? " REGRESSION" : "") << "\n";
+    }
+    for (const auto& nameAndResult : baseline) {
+        if (current.count(nameAndResult.first) == 0) {
+            out << nameAndResult.first << " missing\n";
+        }
+    }
+    return !regressed;
+}
+
+namespace tests {
+    void RunTests();
+    int RunAllTests();
+}
+
+bool ParseUint64Arg(const char* arg, uint64_t* value) {
+    try {
+        size_t parsed = 0;
+        *value = std::stoull(arg, &parsed);
+        return arg[parsed] == '\0';
+    } catch (...) {
+        return false;
+    }
+}
+
+bool ParseDoubleArg(const char* arg, double* value) {
+    try {
+        size_t parsed = 0;
+        *value = std::stod(arg, &parsed);
+        return arg[parsed] == '\0' && *value >= 0;
+    } catch (...) {
+        return false;
+    }
+}
+
+// Parses one of --width <digits>, --max-moves <n> and --no-repeating-rule at argv[*arg].
+bool ParseRulesFlag(int argc, char* argv[], int* arg, RulesVariant* rules) {
+    std::string flag = argv[*arg];
+    uint64_t value;
+    if (flag == "--width" && *arg + 1 < argc && ParseUint64Arg(argv[*arg + 1], &value) && value <= 16) {
+        rules->digits = static_cast<int>(value);
+    } else if (flag == "--max-moves" && *arg + 1 < argc && ParseUint64Arg(argv[*arg + 1], &value) && value <= UINT16_MAX) {
+        rules->maxMoves = static_cast<int>(value);
+    } else if (flag == "--no-repeating-rule") {
+        rules->twoRepeatingDigitsRule = false;
+        return true;
+    } else {
+        return false;
+    }
+    (*arg)++;
+    return true;
+}
+
+// Parses "i/N", shard i of N.
+bool ParseShardArg(const std::string& arg, uint64_t* index, uint64_t* count) {
+    const size_t slash = arg.find('/');
+    return slash != std::string::npos && ParseUint64Arg(arg.substr(0, slash).c_str(), index)
+        && ParseUint64Arg(arg.substr(slash + 1).c_str(), count) && *index < *count;
+}
+
+int RunSweepCommand(int argc, char* argv[]) {
+    CheckpointOptions checkpoint;
+    RulesVariant rules;
+    std::string partialPath;
+    PipelineOptions pipeline;
+    pipeline.progressSeconds = 10;
+    bool sharded = false;
+    uint64_t shardIndex = 0;
+    uint64_t shardCount = 1;
+    // a flag whose value does not parse is an error, rather than a positional argument
+    bool flagsValid = true;
+    std::vector<char*> args;
+    for (int arg = 0; arg < argc; arg++) {
+        std::string flag = argv[arg];
+        uint64_t seconds = 0;
+        if (flag == "--checkpoint") {
+            flagsValid &= ++arg < argc;
+            checkpoint.path = arg < argc ? argv[arg] : "";
+        } else if (flag == "--checkpoint-seconds") {
+            flagsValid &= ++arg < argc && ParseUint64Arg(argv[arg], &seconds) && seconds > 0;
+            checkpoint.intervalSeconds = static_cast<unsigned>(seconds);
+        } else if (flag == "--progress") {
+            flagsValid &= ++arg < argc && ParseUint64Arg(argv[arg], &seconds);
+            pipeline.progressSeconds = static_cast<double>(seconds);
+        } else if (flag == "--partial") {
+            flagsValid &= ++arg < argc;
+            partialPath = arg < argc ? argv[arg] : "";
+        } else if (flag == "--shard") {
+            flagsValid &= ++arg < argc && ParseShardArg(argv[arg], &shardIndex, &shardCount);
+            sharded = true;
+        } else if (!ParseRulesFlag(argc, argv, &arg, &rules)) {
+            args.push_back(argv[arg]);
+        }
+    }
+    argc = static_cast<int>(args.size());
+    argv = args.data();
+
+    uint64_t lo;
+    uint64_t hi;
+    uint64_t threadCount = 0;
+    uint64_t cacheMegabytes = 0;
+    if (argc < 4 || !ParseUint64Arg(argv[2], &lo) || !ParseUint64Arg(argv[3], &hi)
+        || (argc > 4 && !ParseUint64Arg(argv[4], &threadCount))
+        || (argc > 5 && !ParseUint64Arg(argv[5], &cacheMegabytes)) || lo > hi
+        || (argc > 6 && !checkpoint.path.empty()) || !flagsValid || !VisitRules(rules, [](auto) {})) {
+        std::cout << "Usage: " << argv[0] << " sweep <lo> <hi> [threads] [cacheMegabytes] [results.bin]" << std::endl;
+        std::cout << "       " << argv[0] << " sweep <lo> <hi> [threads] [cacheMegabytes] --checkpoint <file> [--checkpoint-seconds <n>]" << std::endl;
+        std::cout << "Progress flag: --progress <seconds> between reports on stderr, 0 for none, 10 by default" << std::endl;
+        std::cout << "Shard flags: --shard <i>/<N> sweeps shard i of N of [lo, hi], --partial <file> saves the result for merge" << std::endl;
+        std::cout << "Rules flags: --width 8|10|12|16, --max-moves 1000|10000, --no-repeating-rule" << std::endl;
+        return 1;
+    }
+    hi = std::min(hi, rules.GetMaxIntValue());
+    if (sharded && !GetShardRange(lo, hi, ResultsFileWriter::DefaultBlockSize, shardIndex, shardCount, &lo, &hi)) {
+        std::cout << "Shard " << shardIndex << "/" << shardCount << " is empty, the range has fewer chunks of "
+            << ResultsFileWriter::DefaultBlockSize << " values than shards" << std::endl;
+        return 1;
+    }
+    if (sharded) {
+        std::cout << "Shard " << shardIndex << "/" << shardCount << " sweeps [" << lo << ", " << hi << "]" << std::endl;
+    }
+    SweepOptions options;
+    options.threadCount = static_cast<unsigned>(threadCount);
+    options.rules = rules;
+    std::unique_ptr<TrajectoryCache> cache;
+    if (cacheMegabytes > 0) {
+        cache.reset(new TrajectoryCache(cacheMegabytes << 20));
+        options.cache = cache.get();
+    }
+    ResultsFileWriter resultsWriter;
+    if (argc > 6) {
+        if (!resultsWriter.Create(argv[6], lo, hi, ResultsFileWriter::DefaultBlockSize, rules)) {
+            std::cout << "Could not create " << argv[6] << std::endl;
+            return 1;
+        }
+        options.resultsWriter = &resultsWriter;
+    }
+    if (checkpoint.path.empty() && partialPath.empty()) {
+        SweepPipelined(lo, hi, options, pipeline).Print();
+    } else {
+        SweepProgress progress;
+        if (!SweepWithCheckpoints(lo, hi, options, checkpoint, &progress)) {
+            std::cout << "Checkpoint " << checkpoint.path << " is not a checkpoint of this sweep or could not be written" << std::endl;
+            return 1;
+        }
+        if (!partialPath.empty() && !progress.Save(partialPath)) {
+            std::cout << "Could not write " << partialPath << std::endl;
+            return 1;
+        }
+        if (!progress.largestWinners.empty()) {
+            std::cout << "Largest winning number: " << progress.largestWinners.front() << std::endl;
+        }
+        progress.stats.Print();
+    }
+    if constexpr (InstrumentSteps) {
+        GetMergedStepCounters().Print();
+    }
+    if (options.resultsWriter != nullptr && !resultsWriter.Close()) {
+        std::cout << "Could not write " << argv[6] << std::endl;
+        return 1;
+    }
+    if (cache) {
+        std::cout << "Trajectory cache hits " << cache->GetHits() << " misses " << cache->GetMisses()
+            << " capacity " << cache->GetCapacity() << std::endl;
+    }
+    return 0;
+}
+
+int RunMergeCommand(int argc, char* argv[]) {
+    if (argc < 3) {
+        std::cout << "Usage: " << argv[0] << " merge <partial>..." << std::endl;
+        return 1;
+    }
+    std::vector<SweepProgress> shards(argc - 2);
+    for (int arg = 2; arg < argc; arg++) {
+        if (!shards[arg - 2].Load(argv[arg])) {
+            std::cout << "Could not read " << argv[arg] << std::endl;
+            return 1;
+        }
+    }
+    MergedShards merged;
+    if (!MergeShards(shards, &merged)) {
+        std::cout << "The shards differ in rules, overlap or are unfinished" << std::endl;
+        return 1;
+    }
+    for (size_t i = 1; i < merged.ranges.size(); i++) {
+        std::cout << "Missing [" << merged.ranges[i - 1].second + 1 << ", " << merged.ranges[i].first - 1 << "]" << std::endl;
+    }
+    if (!merged.largestWinners.empty()) {
+        std::cout << "Largest winning number: " << merged.largestWinners.front() << std::endl;
+    }
+    merged.stats.Print();
+    return 0;
+}
+
+int RunWinnerIndexCommand(int argc, char* argv[]) {
+    RulesVariant rules;
+    std::vector<char*> args;
+    for (int arg = 0; arg < argc; arg++) {
+        if (!ParseRulesFlag(argc, argv, &arg, &rules)) {
+            args.push_back(argv[arg]);
+        }
+    }
+    argc = static_cast<int>(args.size());
+    argv = args.data();
+
+    uint64_t lo;
+    uint64_t hi;
+    uint64_t threadCount = 0;
+    if (argc < 5 || !ParseUint64Arg(argv[3], &lo) || !ParseUint64Arg(argv[4], &hi) || lo > hi
+        || (argc > 5 && !ParseUint64Arg(argv[5], &threadCount)) || !VisitRules(rules, [](auto) {})) {
+        std::cout << "Usage: " << argv[0] << " winner-index <index.bin> <lo> <hi> [threads]" << std::endl;
+        std::cout << "Rules flags: --width 8|10|12|16, --max-moves 1000|10000, --no-repeating-rule" << std::endl;
+        return 1;
+    }
+    SweepOptions options;
+    options.threadCount = static_cast<unsigned>(threadCount);
+    options.rules = rules;
+    WinnerIndex index;
+    if (!BuildWinnerIndex(argv[2], lo, std::min(hi, rules.GetMaxIntValue()), options) || !index.Open(argv[2])) {
+        std::cout << "Could not write " << argv[2] << std::endl;
+        return 1;
+    }
+    std::cout << "Indexed " << index.GetWinnersCount() << " winners in " << index.GetHeader().blockCount << " blocks, "
+        << std::filesystem::file_size(argv[2]) << " bytes" << std::endl;
+    return 0;
+}
+
+int RunSummaryIndexCommand(int argc, char* argv[]) {
+    RulesVariant rules;
+    std::vector<char*> args;
+    for (int arg = 0; arg < argc; arg++) {
+        if (!ParseRulesFlag(argc, argv, &arg, &rules)) {
+            args.push_back(argv[arg]);
+        }
+    }
+    argc = static_cast<int>(args.size());
+    argv = args.data();
+
+    uint64_t lo;
+    uint64_t hi;
+    uint64_t threadCount = 0;
+    if (argc < 5 || !ParseUint64Arg(argv[3], &lo) || !ParseUint64Arg(argv[4], &hi) || lo > hi
+        || (argc > 5 && !ParseUint64Arg(argv[5], &threadCount)) || !VisitRules(rules, [](auto) {})) {
+        std::cout << "Usage: " << argv[0] << " summary-index <summary.bin> <lo> <hi> [threads]" << std::endl;
+        std::cout << "Rules flags: --width 8|10|12|16, --max-moves 1000|10000, --no-repeating-rule" << std::endl;
+        return 1;
+    }
+    SweepOptions options;
+    options.threadCount = static_cast<unsigned>(threadCount);
+    options.rules = rules;
+    SummaryIndex index;
+    if (!BuildSummaryIndex(argv[2], lo, std::min(hi, rules.GetMaxIntValue()), options) || !index.Open(argv[2])) {
+        std::cout << "Could not write " << argv[2] << std::endl;
+        return 1;
+    }
+    std::cout << "Summarized " << index.GetHeader().leafCount << " blocks in " << index.GetHeader().GetLevelsCount()
+        << " levels, " << std::filesystem::file_size(argv[2]) << " bytes" << std::endl;
+    return 0;
+}
+
+int RunRangeStatsCommand(int argc, char* argv[]) {
+    uint64_t a;
+    uint64_t b;
+    if (argc < 5 || !ParseUint64Arg(argv[3], &a) || !ParseUint64Arg(argv[4], &b) || a > b) {
+        std::cout << "Usage: " << argv[0] << " range-stats <summary.bin> <a> <b> [results.bin]" << std::endl;
+        return 1;
+    }
+    SummaryIndex index;
+    ResultsFileReader results;
+    for (int arg = 2; arg < std::min(argc, 6); arg += 3) {
+        if (!(arg == 2 ? index.Open(argv[arg]) : results.Open(argv[arg]))) {
+            std::cout << "Could not read " << argv[arg] << std::endl;
+            return 1;
+        }
+    }
+    auto start = std::chrono::steady_clock::now();
+    uint64_t gamesPlayed = 0;
+    const RangeSummary summary = index.GetRangeSummary(a, b, argc > 5 ? &results : nullptr, &gamesPlayed);
+    auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Summarized " << summary.GetTotalGames() << " games in " << elapsed << " ms, " << gamesPlayed
+        << " of them played" << std::endl;
+    summary.Print();
+    return 0;
+}
+
+int RunWinnersCommand(int argc, char* argv[]) {
+    WinnerIndex index;
+    const std::string query = argc > 3 ? argv[3] : "";
+    uint64_t value = 0;
+    uint64_t other = 0;
+    const bool twoValues = query == "count" || query == "below";
+    if (argc != (twoValues ? 6 : 5) || !ParseUint64Arg(argv[4], &value) || (twoValues && !ParseUint64Arg(argv[5], &other))) {
+        std::cout << "Usage: " << argv[0] << " winners <index.bin> contains|rank|select|prev|next <n>" << std::endl;
+        std::cout << "       " << argv[0] << " winners <index.bin> count <a> <b>" << std::endl;
+        std::cout << "       " << argv[0] << " winners <index.bin> below <X> <k>, the k-th largest winner below X" << std::endl;
+        return 1;
+    }
+    if (!index.Open(argv[2])) {
+        std::cout << "Could not read " << argv[2] << std::endl;
+        return 1;
+    }
+    uint64_t winner = 0;
+    bool found = true;
+    if (query == "contains") {
+        std::cout << value << (index.Contains(value) ? " is a winner" : " is not a winner") << std::endl;
+    } else if (query == "rank") {
+        std::cout << index.Rank(value) << " winners up to " << value << std::endl;
+    } else if (query == "count") {
+        std::cout << index.CountInRange(value, other) << " winners in [" << value << ", " << other << "]" << std::endl;
+    } else if (query == "select") {
+        found = index.Select(value, &winner);
+    } else if (query == "prev") {
+        found = index.Predecessor(value, &winner);
+    } else if (query == "next") {
+        found = index.Successor(value, &winner);
+    } else if (query == "below") {
+        const uint64_t rank = value > 0 ? index.Rank(value - 1) : 0;
+        found = other >= 1 && other <= rank && index.Select(rank - other, &winner);
+    } else {
+        std::cout << "Unknown query " << query << std::endl;
+        return 1;
+    }
+    if (!found) {
+        std::cout << "No such winner" << std::endl;
+    } else if (query == "select" || query == "prev" || query == "next" || query == "below") {
+        std::cout << winner << std::endl;
+    }
+    return 0;
+}
+
+int RunSmallTableCommand(int argc, char* argv[]) {
+    uint64_t bound;
+    uint64_t threadCount = 0;
+    if (argc < 4 || !ParseUint64Arg(argv[3], &bound) || bound == 0 || bound > MaxCalculatorIntValue
+        || (argc > 4 && !ParseUint64Arg(argv[4], &threadCount))) {
+        std::cout << "Usage: " << argv[0] << " small-table <table.bin> <bound> [threads]" << std::endl;
+        std::cout << "Any command then takes --small-table <table.bin> to finish games below the bound with a lookup" << std::endl;
+        return 1;
+    }
+    if (!BuildSmallValueTable(argv[2], bound, static_cast<unsigned>(threadCount))) {
+        std::cout << "Could not write " << argv[2] << std::endl;
+        return 1;
+    }
+    std::cout << "Stored the games below " << bound << ", " << std::filesystem::file_size(argv[2]) << " bytes" << std::endl;
+    return 0;
+}
+
+int RunLookupCommand(int argc, char* argv[]) {
+    ResultsFileReader reader;
+    if (argc < 4) {
+        std::cout << "Usage: " << argv[0] << " lookup <results.bin> <startValue>..." << std::endl;
+        return 1;
+    }
+    if (!reader.Open(argv[2])) {
+        std::cout << "Could not read " << argv[2] << std::endl;
+        return 1;
+    }
+    for (int arg = 3; arg < argc; arg++) {
+        uint64_t startValue;
+        GameResults results;
+        if (!ParseUint64Arg(argv[arg], &startValue) || !reader.Lookup(startValue, &results)) {
+            std::cout << argv[arg] << " not stored" << std::endl;
+            continue;
+        }
+        std::cout << startValue << " " << OverallStats::ToString(results.outcome) << " in " << results.stepsCount << " steps";
+        if (results.finalValue) {
+            std::cout << " at " << results.finalValue->ToString();
+        }
+        if (results.outcome == GameOutcome::cycle) {
+            std::cout << ", cycle of " << results.cycleLength << " from step " << results.cycleEntryStep;
+        }
+        std::cout << std::endl;
+    }
+    return 0;
+}
+
+int RunLargestCommand(int argc, char* argv[]) {
+    uint64_t below;
+    uint64_t count = 1;
+    uint64_t threadCount = 0;
+    if (argc < 3 || !ParseUint64Arg(argv[2], &below) || below <= 11
+        || (argc > 3 && !ParseUint64Arg(argv[3], &count))
+        || (argc > 4 && !ParseUint64Arg(argv[4], &threadCount))) {
+        std::cout << "Usage: " << argv[0] << " largest <below> [count] [threads]" << std::endl;
+        return 1;
+    }
+    WinnerSearchOptions options;
+    options.threadCount = static_cast<unsigned>(threadCount);
+    for (uint64_t winner : FindLargestWinners(11, std::min(below - 1, MaxCalculatorIntValue), count, options)) {
+        std::cout << "Winning number below " << below << ": " << winner << std::endl;
+    }
+    return 0;
+}
+
+int RunSampleCommand(int argc, char* argv[]) {
+    SamplingOptions options;
+    // a flag whose value does not parse is an error, rather than a positional argument
+    bool flagsValid = true;
+    std::vector<char*> args;
+    for (int arg = 0; arg < argc; arg++) {
+        std::string flag = argv[arg];
+        uint64_t value = 0;
+        if (flag == "--seed") {
+            flagsValid &= ++arg < argc && ParseUint64Arg(argv[arg], &options.seed);
+        } else if (flag == "--leading-digits") {
+            flagsValid &= ++arg < argc && ParseUint64Arg(argv[arg], &value) && value >= 1 && value <= 19;
+            options.leadingDigits = static_cast<int>(value);
+        } else if (flag == "--max-games") {
+            flagsValid &= ++arg < argc && ParseUint64Arg(argv[arg], &options.maxGames);
+        } else if (!ParseRulesFlag(argc, argv, &arg, &options.rules)) {
+            args.push_back(argv[arg]);
+        }
+    }
+    argc = static_cast<int>(args.size());
+    argv = args.data();
+
+    uint64_t lo;
+    uint64_t hi;
+    uint64_t threadCount = 0;
+    if (argc < 4 || !ParseUint64Arg(argv[2], &lo) || !ParseUint64Arg(argv[3], &hi) || lo > hi
+        || (argc > 4 && !ParseDoubleArg(argv[4], &options.precisionPercent))
+        || (argc > 5 && !ParseDoubleArg(argv[5], &options.timeBudgetSeconds))
+        || (argc > 6 && !ParseUint64Arg(argv[6], &threadCount)) || !flagsValid || !VisitRules(options.rules, [](auto) {})) {
+        std::cout << "Usage: " << argv[0] << " sample <lo> <hi> [precisionPercent] [seconds] [threads]"
+            " [--seed <n>] [--leading-digits <n>] [--max-games <n>]" << std::endl;
+        std::cout << "Rules flags: --width 8|10|12|16, --max-moves 1000|10000, --no-repeating-rule" << std::endl;
+        return 1;
+    }
+    options.threadCount = static_cast<unsigned>(threadCount);
+    SampleStats(lo, std::min(hi, options.rules.GetMaxIntValue()), options).Print();
+    return 0;
+}
+
+int RunDifferentialCommand(int argc, char* argv[]) {
+    DifferentialOptions options;
+    bool flagsValid = true;
+    std::vector<char*> args;
+    for (int arg = 0; arg < argc; arg++) {
+        std::string flag = argv[arg];
+        if (flag == "--seed") {
+            flagsValid &= ++arg < argc && ParseUint64Arg(argv[arg], &options.seed);
+        } else if (flag == "--no-edges") {
+            options.edgeValues = false;
+        } else {
+            args.push_back(argv[arg]);
+        }
+    }
+    argc = static_cast<int>(args.size());
+    argv = args.data();
+
+    uint64_t threadCount = 0;
+    if ((argc > 2 && !ParseUint64Arg(argv[2], &options.exhaustiveHi))
+        || (argc > 3 && !ParseUint64Arg(argv[3], &options.randomSamples))
+        || (argc > 4 && !ParseUint64Arg(argv[4], &threadCount)) || options.exhaustiveHi > MaxCalculatorIntValue || !flagsValid) {
+        std::cout << "Usage: " << argv[0] << " difftest [exhaustiveHi] [randomSamples] [threads] [--seed <n>] [--no-edges]" << std::endl;
+        return 1;
+    }
+    options.threadCount = static_cast<unsigned>(threadCount);
+    TrajectoryCache cache(64 << 20);
+    const std::vector<DifferentialEngine> engines = GetDifferentialEngines(&cache);
+    DifferentialMismatch mismatch;
+    uint64_t gamesCompared = 0;
+    if (RunDifferentialTest(engines, options, &mismatch, &gamesCompared)) {
+        std::cout << "All " << engines.size() << " engines matched the reference on " << gamesCompared << " games" << std::endl;
+        return 0;
+    }
+    std::cout << "Engine " << mismatch.engine << " differs from the reference after " << gamesCompared << " matching games" << std::endl;
+    std::cout << "  expected " << DescribeGameResults(mismatch.expected) << std::endl;
+    std::cout << "  actual   " << DescribeGameResults(mismatch.actual) << std::endl;
+    std::cout << "Minimized to the game from step " << mismatch.minimizedAtStep << ":" << std::endl;
+    std::cout << "  expected " << DescribeGameResults(mismatch.minimizedExpected) << std::endl;
+    std::cout << "  actual   " << DescribeGameResults(mismatch.minimizedActual) << std::endl;
+    TrajectoryRecorder recorder;
+    GameResults results = Play(mismatch.minimizedExpected.startValue, nullptr, &recorder);
+    std::cout << "  ";
+    WriteTrajectory(std::cout, results, recorder);
+    return 1;
+}
+
+int RunBackwardCommand(int argc, char* argv[]) {
+    RulesVariant rules;
+    std::vector<char*> args;
+    for (int arg = 0; arg < argc; arg++) {
+        if (!ParseRulesFlag(argc, argv, &arg, &rules)) {
+            args.push_back(argv[arg]);
+        }
+    }
+    argc = static_cast<int>(args.size());
+    argv = args.data();
+
+    uint64_t lo;
+    uint64_t hi;
+    uint64_t maxSteps;
+    uint64_t threadCount = 0;
+    if (argc < 5 || !ParseUint64Arg(argv[2], &lo) || !ParseUint64Arg(argv[3], &hi) || lo > hi
+        || !ParseUint64Arg(argv[4], &maxSteps) || maxSteps == 0 || maxSteps > INT32_MAX
+        || (argc > 5 && !ParseUint64Arg(argv[5], &threadCount)) || rules.digits > 10 || !VisitRules(rules, [](auto) {})) {
+        std::cout << "Usage: " << argv[0] << " backward <lo> <hi> <maxSteps> [threads]" << std::endl;
+        std::cout << "Finds the numbers in [lo, hi] that finish within maxSteps steps. This is not the full winning set;"
+            << " the search grows quickly with maxSteps." << std::endl;
+        std::cout << "Rules flags: --width 8|10, --max-moves 1000|10000, --no-repeating-rule" << std::endl;
+        return 1;
+    }
+    BackwardSearchOptions options;
+    options.threadCount = static_cast<unsigned>(threadCount);
+    options.maxSteps = static_cast<int>(maxSteps);
+    std::vector<GameResults> winners;
+    VisitRules(rules, [&](auto rules) {
+        using Rules = decltype(rules);
+        if constexpr (Rules::Digits <= 10) {
+            winners = FindWinnersBackward<Rules>(lo, std::min(hi, Rules::MaxIntValue), &options);
+        }
+    });
+    std::cout << "Winning numbers: " << winners.size() << ", searched the predecessors of "
+        << options.statesExpanded << " states" << std::endl;
+    if (!winners.empty()) {
+        std::cout << "Largest winning number: " << winners.back().startValue << std::endl;
+        OverallStats stats;
+        for (GameResults& results : winners) {
+            stats.AddRun(std::move(results));
+        }
+        stats.Print();
+    }
+    return 0;
+}
+
+#ifndef _WIN32
+QueryServer* RunningQueryServer = nullptr;
+
+void StopQueryServer(int) {
+    RunningQueryServer->Stop();
+}
+#endif
+
+int RunServeCommand(int argc, char* argv[]) {
+    uint64_t threadCount = 0;
+    if (argc < 3 || (argc > 4 && !ParseUint64Arg(argv[4], &threadCount))) {
+        std::cout << "Usage: " << argv[0] << " serve <socket> [results.bin] [threads]" << std::endl;
+        return 1;
+    }
+#ifdef _WIN32
+    std::cout << "serve needs Unix domain sockets, which this build does not have" << std::endl;
+    return 1;
+#else
+    QueryEngine engine(static_cast<unsigned>(threadCount));
+    if (argc > 3 && !engine.OpenResults(argv[3])) {
+        std::cout << "Could not open " << argv[3] << " or it is not of the default rules" << std::endl;
+        return 1;
+    }
+    QueryServer server(engine);
+    if (!server.Listen(argv[2])) {
+        std::cout << "Could not listen on " << argv[2] << std::endl;
+        return 1;
+    }
+    RunningQueryServer = &server;
+    signal(SIGINT, StopQueryServer);
+    signal(SIGTERM, StopQueryServer);
+    std::cout << "Serving on " << argv[2] << std::endl;
+    server.Run();
+    RunningQueryServer = nullptr;
+    std::cout << "Played " << server.GetBatchesPlayed() << " batches" << std::endl;
+    return 0;
+#endif
+}
+
+int RunQueryCommand(int argc, char* argv[]) {
+    const std::string query = argc > 3 ? argv[3] : "";
+    uint64_t lo = 0;
+    uint64_t hi = 0;
+    uint64_t count = 1;
+    std::vector<uint64_t> startValues;
+    for (int arg = 4; query == "play" && arg < argc; arg++) {
+        startValues.push_back(0);
+        if (!ParseUint64Arg(argv[arg], &startValues.back())) {
+            startValues.clear();
+            break;
+        }
+    }
+    bool isRangeQuery = (query == "stats" || query == "largest") && argc > 5
+        && ParseUint64Arg(argv[4], &lo) && ParseUint64Arg(argv[5], &hi) && lo <= hi
+        && (argc < 7 || (query == "largest" && ParseUint64Arg(argv[6], &count) && count <= MaxQueryWinners));
+    if (startValues.empty() && !isRangeQuery) {
+        std::cout << "Usage: " << argv[0] << " query <socket> play <startValue>..." << std::endl;
+        std::cout << "       " << argv[0] << " query <socket> stats <lo> <hi>" << std::endl;
+        std::cout << "       " << argv[0] << " query <socket> largest <lo> <hi> [count]" << std::endl;
+        return 1;
+    }
+#ifdef _WIN32
+    std::cout << "query needs Unix domain sockets, which this build does not have" << std::endl;
+    return 1;
+#else
+    QueryClient client;
+    if (!client.Connect(argv[2])) {
+        std::cout << "Could not connect to " << argv[2] << std::endl;
+        return 1;
+    }
+    bool answered;
+    if (query == "play") {
+        std::vector<GameResults> results;
+        answered = client.Play(startValues.data(), startValues.size(), &results);
+        for (size_t i = 0; answered && i < results.size(); i++) {
+            std::cout << results[i].startValue << ": " << OverallStats::ToString(results[i].outcome)
+                << " in " << results[i].stepsCount << " steps";
+            if (results[i].finalValue) {
+                std::cout << ", final value " << results[i].finalValue->ToString();
+            }
+            std::cout << std::endl;
+        }
+    } else if (query == "stats") {
+        OverallStats stats;
+        answered = client.GetRangeStats(lo, hi, &stats);
+        if (answered) {
+            stats.Print();
+        }
+    } else {
+        std::vector<uint64_t> winners;
+        answered = client.GetLargestWinners(lo, hi, static_cast<size_t>(count), &winners);
+        for (size_t i = 0; answered && i < winners.size(); i++) {
+            std::cout << "Winning number in [" << lo << ", " << hi << "]: " << winners[i] << std::endl;
+        }
+    }
+    if (!answered) {
+        std::cout << "The server did not answer the query" << std::endl;
+        if (query != "play") {
+            std::cout << "A range may hold at most " << MaxQueryRangeValues << " start values, and at most " << MaxQueryPlayedValues
+                << " the server's results file does not cover" << std::endl;
+        }
+        return 1;
     }
-    return false;
+    return 0;
+#endif
 }
 
-class OutcomeStats {
-public:
-    OutcomeStats() : totalRuns_(0), totalSteps_(0) {}
-
-    void AddRun(uint64_t stepsCount) {
-        totalRuns_++;
-        totalSteps_ += stepsCount;
+int RunTraceCommand(int argc, char* argv[]) {
+    uint64_t lo;
+    uint64_t hi;
+    std::optional<GameOutcome> outcome;
+    if (argc > 4) {
+        for (const auto gameOutcome : AllGameOutcomes) {
+            if (OverallStats::ToString(gameOutcome) == argv[4]) {
+                outcome = gameOutcome;
+            }
+        }
     }
-
-    uint64_t GetTotalRuns() const { return totalRuns_; }
-    double GetAvgStepsPerGame() const { return (1.0 * totalSteps_) / totalRuns_; }
-private:
-    uint64_t totalRuns_;
-    uint64_t totalSteps_;
-};
-
-class OverallStats {
-public:
-    OverallStats();
-    void AddRun(GameResults&& results);
-    void Print() const;
-private:
-    static const std::string& ToString(GameOutcome outcome);
-private:
-    std::unordered_map<GameOutcome, OutcomeStats> stats_;
-    uint64_t totalGames_;
-};
-
-OverallStats::OverallStats() : totalGames_(0) {
-    for (const auto gameOutcome : AllGameOutcomes) {
-        stats_[gameOutcome] = OutcomeStats();
+    if (argc < 3 || !ParseUint64Arg(argv[2], &lo) || (argc > 3 && !ParseUint64Arg(argv[3], &hi)) || (argc > 4 && !outcome)) {
+        std::cout << "Usage: " << argv[0] << " trace <lo> [hi] [finished|overflow|tooManyMoves|cycle]" << std::endl;
+        return 1;
     }
+    hi = std::min(argc > 3 ? hi : lo, MaxCalculatorIntValue);
+    WriteTrajectories(std::cout, lo, hi, [&](const GameResults& results) { return !outcome || results.outcome == *outcome; });
+    std::cout << std::flush;
+    return 0;
 }
 
-void OverallStats::AddRun(GameResults&& results) {
-    stats_[results.outcome].AddRun(results.stepsCount);
-    totalGames_++;
+int RunDigitsBenchCommand(int argc, char* argv[]) {
+    uint64_t valuesPerLength = 1 << 20;
+    if (argc > 2 && !ParseUint64Arg(argv[2], &valuesPerLength)) {
+        std::cout << "Usage: " << argv[0] << " bench-digits [valuesPerLength]" << std::endl;
+        return 1;
+    }
+    auto timeNanos = [&](const std::vector<uint64_t>& values, const std::function<uint64_t(uint64_t)>& kernel) {
+        uint64_t checksum = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (uint64_t n : values) {
+            checksum += kernel(n);
+        }
+        auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        BenchSink = checksum;
+        return elapsed / values.size();
+    };
+    auto repeatingByLoop = [](uint64_t n) { uint64_t value; return HasTwoRepeatingDigitsByLoop(n, &value) + value; };
+    auto repeatingByTable = [](uint64_t n) { uint64_t value; return HasTwoRepeatingDigits(n, &value) + value; };
+
+    std::mt19937_64 random(valuesPerLength);
+    for (int digits = 2; digits <= DigitsInCalculator; digits++) {
+        std::uniform_int_distribution<uint64_t> distribution(PowersOfTen[digits - 1], PowersOfTen[digits] - 1);
+        std::vector<uint64_t> values(valuesPerLength);
+        for (uint64_t& n : values) {
+            n = distribution(random);
+        }
+        std::cout << "digits " << digits
+            << " HasTwoRepeatingDigits loop " << timeNanos(values, repeatingByLoop)
+            << " ns table " << timeNanos(values, repeatingByTable)
+            << " ns, SuffixDivisor loop " << timeNanos(values, SuffixDivisorByLoop)
+            << " ns table " << timeNanos(values, SuffixDivisor) << " ns" << std::endl;
+    }
+    return 0;
 }
 
-void OverallStats::Print() const {
-    for (const auto gameOutcome : AllGameOutcomes) {
-        const OutcomeStats& stats = stats_.at(gameOutcome);
-        if (stats.GetTotalRuns() == 0) {
-            continue;
+int RunBenchCommand(int argc, char* argv[]) {
+    BenchmarkOptions options;
+    uint64_t setSize = options.setSize;
+    uint64_t repetitions = options.repetitions;
+    if ((argc > 3 && !ParseUint64Arg(argv[3], &repetitions)) || (argc > 4 && !ParseUint64Arg(argv[4], &setSize))
+        || repetitions == 0 || setSize == 0) {
+        std::cout << "Usage: " << argv[0] << " bench [output.json|-] [repetitions] [setSize]" << std::endl;
+        return 1;
+    }
+    options.setSize = static_cast<size_t>(setSize);
+    options.repetitions = static_cast<int>(repetitions);
+    std::vector<BenchmarkResult> results = RunBenchmarkSuite(options);
+    if (argc > 2 && std::string(argv[2]) != "-") {
+        std::ofstream out(argv[2]);
+        WriteBenchmarkJson(out, options, results);
+        if (!out) {
+            std::cout << "Could not write " << argv[2] << std::endl;
+            return 1;
         }
-        std::cout << "Outcome " << ToString(gameOutcome)
-            << " occured " << 100.0 * stats.GetTotalRuns() / totalGames_ << "% of times"
-            << " and finished in " << stats.GetAvgStepsPerGame() << " of steps in average"
-            << std::endl;        
+    } else {
+        WriteBenchmarkJson(std::cout, options, results);
     }
+    return 0;
 }
 
-const std::string& OverallStats::ToString(GameOutcome outcome) {
-    static const std::string sFinished = "finished";
-    static const std::string sOverflow = "overflow";
-    static const std::string sTooManyMoves = "tooManyMoves";
-    switch (outcome) {
-        case GameOutcome::finished: return sFinished;
-        case GameOutcome::overflow: return sOverflow;
-        case GameOutcome::tooManyMoves: return sTooManyMoves;
-        default: throw "Unhandled GameOutcome";
+int RunBenchCompareCommand(int argc, char* argv[]) {
+    std::map<std::string, BenchmarkResult> baseline;
+    std::map<std::string, BenchmarkResult> current;
+    double thresholdPercent = 5;
+    if (argc < 4 || (argc > 4 && (thresholdPercent = std::atof(argv[4])) <= 0)) {
+        std::cout << "Usage: " << argv[0] << " bench-compare <baseline.json> <current.json> [thresholdPercent]" << std::endl;
+        return 1;
     }
+    if (!ReadBenchmarkJson(argv[2], &baseline) || !ReadBenchmarkJson(argv[3], &current)) {
+        std::cout << "Could not read " << argv[2] << " or " << argv[3] << std::endl;
+        return 1;
+    }
+    return CompareBenchmarks(std::cout, baseline, current, thresholdPercent) ? 0 : 2;
 }
 
-namespace tests {
-    void RunTests();
+int RunTestCommand(int argc, char* argv[]) {
+    if (argc > 2) {
+        std::cout << "Usage: " << argv[0] << " test" << std::endl;
+        return 1;
+    }
+    const int failures = tests::RunAllTests();
+    if (failures != 0) {
+        std::cout << failures << " test failures" << std::endl;
+        return 1;
+    }
+    std::cout << "All tests passed" << std::endl;
+    return 0;
 }
 
-int main()
+int main(int argc, char* argv[])
 {
+    if (argc > 1 && std::string(argv[1]) == "test") {
+        return RunTestCommand(argc, argv);
+    }
     tests::RunTests();
+    if constexpr (InstrumentSteps) {
+        ResetStepCounters();
+    }
 
-    uint64_t n;
-    for (n = MaxCalculatorIntValue; n > 10; n--) {
-        if (Play(n).outcome == GameOutcome::finished) {
-            std::cout << "Largest winning number: " << n << std::endl;
-            break;
+    std::vector<char*> args;
+    for (int arg = 0; arg < argc; arg++) {
+        if (std::string(argv[arg]) == "--small-table" && arg + 1 < argc) {
+            if (!LoadSmallValueTable(argv[++arg])) {
+                std::cout << "Could not load the small value table " << argv[arg] << std::endl;
+                return 1;
+            }
+        } else {
+            args.push_back(argv[arg]);
         }
     }
-        
-    OverallStats stats;
-    for (uint64_t n = 10; n <= 9999; n++) {
-        stats.AddRun(Play(n));
+    argc = static_cast<int>(args.size());
+    argv = args.data();
+
+    if (argc > 1 && std::string(argv[1]) == "sweep") {
+        return RunSweepCommand(argc, argv);
+    }
+    if (argc > 1 && std::string(argv[1]) == "merge") {
+        return RunMergeCommand(argc, argv);
+    }
+    if (argc > 1 && std::string(argv[1]) == "winner-index") {
+        return RunWinnerIndexCommand(argc, argv);
+    }
+    if (argc > 1 && std::string(argv[1]) == "summary-index") {
+        return RunSummaryIndexCommand(argc, argv);
+    }
+    if (argc > 1 && std::string(argv[1]) == "range-stats") {
+        return RunRangeStatsCommand(argc, argv);
+    }
+    if (argc > 1 && std::string(argv[1]) == "winners") {
+        return RunWinnersCommand(argc, argv);
+    }
+    if (argc > 1 && std::string(argv[1]) == "small-table") {
+        return RunSmallTableCommand(argc, argv);
+    }
+    if (argc > 1 && std::string(argv[1]) == "lookup") {
+        return RunLookupCommand(argc, argv);
+    }
+    if (argc > 1 && std::string(argv[1]) == "largest") {
+        return RunLargestCommand(argc, argv);
+    }
+    if (argc > 1 && std::string(argv[1]) == "sample") {
+        return RunSampleCommand(argc, argv);
+    }
+    if (argc > 1 && std::string(argv[1]) == "difftest") {
+        return RunDifferentialCommand(argc, argv);
+    }
+    if (argc > 1 && std::string(argv[1]) == "backward") {
+        return RunBackwardCommand(argc, argv);
+    }
+    if (argc > 1 && std::string(argv[1]) == "serve") {
+        return RunServeCommand(argc, argv);
+    }
+    if (argc > 1 && std::string(argv[1]) == "query") {
+        return RunQueryCommand(argc, argv);
+    }
+    if (argc > 1 && std::string(argv[1]) == "trace") {
+        return RunTraceCommand(argc, argv);
+    }
+    if (argc > 1 && std::string(argv[1]) == "bench") {
+        return RunBenchCommand(argc, argv);
+    }
+    if (argc > 1 && std::string(argv[1]) == "bench-compare") {
+        return RunBenchCompareCommand(argc, argv);
+    }
+    if (argc > 1 && std::string(argv[1]) == "bench-digits") {
+        return RunDigitsBenchCommand(argc, argv);
+    }
+
+    std::optional<uint64_t> largestWinner = FindLargestWinner(11, MaxCalculatorIntValue);
+    if (largestWinner) {
+        std::cout << "Largest winning number: " << *largestWinner << std::endl;
+    }
+
+    SweepStats(10, 9999).Print();
+    if constexpr (InstrumentSteps) {
+        GetMergedStepCounters().Print();
     }
-    stats.Print();
     return 0;
 }
 
@@ -283,30 +5788,54 @@ int main()
 
 namespace tests {
     std::string testName;
+    int failures = 0;
+
+    // Temp files are named per process so that concurrently started shards can all run the tests.
+    std::string GetTestTempPath(const std::string& name) {
+#ifdef _WIN32
+        const unsigned long processId = GetCurrentProcessId();
+#else
+        const unsigned long processId = static_cast<unsigned long>(getpid());
+#endif
+        return (std::filesystem::temp_directory_path() / (name + std::to_string(processId))).string();
+    }
 
     void RunTests();
 
     void asserts(const uint64_t valueTested, bool actual0, uint64_t actual1, uint64_t expected1) {
         if (!actual0) {
+            failures++;
             std::cout << "Test failure " << testName << " valueTested=" << valueTested << " bool condition failed" << std::endl;
         }
         if (actual1 != expected1) {
+            failures++;
             std::cout << "Test failure " << testName << " valueTested=" << valueTested << " expected1=" << expected1 << " actual1=" << actual1 << std::endl;
         }
     }
 
     void asserts(const double valueTested, const double expected0, const double actual0) {
         if (actual0 != expected0) {
+            failures++;
             std::cout << "Test failure " << testName << " valueTested=" << valueTested << " expected0=" << expected0 << " actual0=" << actual0 << std::endl;
         }
     }
 
+    void asserts(const double valueTested, const double expected0, const CalculatorState& actual0) {
+        CalculatorState expectedState = CalculatorState::FromDouble(expected0);
+        if (actual0 != expectedState) {
+            failures++;
+            std::cout << "Test failure " << testName << " valueTested=" << valueTested << " expected0=" << expectedState.ToString() << " actual0=" << actual0.ToString() << std::endl;
+        }
+    }
+
     void asserts(const double valueTested, const uint64_t expected0, const uint64_t actual0, const uint64_t expected1, const uint64_t actual1) {
         if (actual0 != expected0) {
+            failures++;
             std::cout << "Test failure " << testName << " valueTested=" << valueTested << " expected0=" << expected0 << " actual0=" << actual0 << std::endl;
             return;
         }
         if (actual1 != expected1) {
+            failures++;
             std::cout << "Test failure " << testName << " valueTested=" << valueTested << " expected1=" << expected1 << " actual1=" << actual1 << std::endl;
             return;
         }
@@ -314,6 +5843,14 @@ namespace tests {
 
     void asserts(const uint64_t valueTested, const GameResults& expected, const GameResults& actual) {
         if (expected != actual) {
+            failures++;
+            std::cout << "Test failure " << testName << " valueTested=" << valueTested << std::endl;
+        }
+    }
+
+    void asserts(const uint64_t valueTested, const OverallStats& expected, const OverallStats& actual) {
+        if (!(expected == actual)) {
+            failures++;
             std::cout << "Test failure " << testName << " valueTested=" << valueTested << std::endl;
         }
     }
@@ -370,8 +5907,8 @@ namespace tests {
     void TestNextStepForInt() {
         testName = "TestNextStepForInt";
 
-        double valueTested = 0;
-        double res = 0;
+        uint64_t valueTested = 0;
+        CalculatorState res;
 
         res = NextStepForInt(valueTested = 0);
         asserts(valueTested, 0, res);
@@ -395,49 +5932,49 @@ namespace tests {
         asserts(valueTested, 11, res);
 
         res = NextStepForInt(valueTested = 771);
-        asserts(valueTested, valueTested / 71, res);
+        asserts(valueTested, valueTested / 71.0, res);
 
         res = NextStepForInt(valueTested = 7710);
-        asserts(valueTested, valueTested / 10, res);
+        asserts(valueTested, valueTested / 10.0, res);
 
         res = NextStepForInt(valueTested = 77100);
-        asserts(valueTested, valueTested / 100, res);
+        asserts(valueTested, valueTested / 100.0, res);
 
         res = NextStepForInt(valueTested = 77105);
-        asserts(valueTested, valueTested / 105, res);
+        asserts(valueTested, valueTested / 105.0, res);
 
         res = NextStepForInt(valueTested = 177105);
-        asserts(valueTested, valueTested / 105, res);
+        asserts(valueTested, valueTested / 105.0, res);
 
         res = NextStepForInt(valueTested = 13775);
-        asserts(valueTested, valueTested / 5, res);
+        asserts(valueTested, valueTested / 5.0, res);
 
         res = NextStepForInt(valueTested = 771052);
-        asserts(valueTested, valueTested / 1052, res);
+        asserts(valueTested, valueTested / 1052.0, res);
 
         res = NextStepForInt(valueTested = 761052);
-        asserts(valueTested, valueTested / 2, res);
+        asserts(valueTested, valueTested / 2.0, res);
 
         res = NextStepForInt(valueTested = 32771052);
-        asserts(valueTested, valueTested / 1052, res);
+        asserts(valueTested, valueTested / 1052.0, res);
 
         res = NextStepForInt(valueTested = 42001052);
-        asserts(valueTested, valueTested / 1052, res);
+        asserts(valueTested, valueTested / 1052.0, res);
 
         res = NextStepForInt(valueTested = 5277105200);
-        asserts(valueTested, valueTested / 105200, res);
+        asserts(valueTested, valueTested / 105200.0, res);
 
         res = NextStepForInt(valueTested = 6276105200);
-        asserts(valueTested, valueTested / 200, res);
+        asserts(valueTested, valueTested / 200.0, res);
 
         res = NextStepForInt(valueTested = 7276105201);
-        asserts(valueTested, valueTested / 201, res);
+        asserts(valueTested, valueTested / 201.0, res);
 
         res = NextStepForInt(valueTested = 8276105203);
-        asserts(valueTested, valueTested / 3, res);
+        asserts(valueTested, valueTested / 3.0, res);
 
         res = NextStepForInt(valueTested = 9276105211);
-        asserts(valueTested, valueTested / 11, res);
+        asserts(valueTested, valueTested / 11.0, res);
     }
 
     void TestBreakFractionToIntAndFracPart() {
@@ -448,101 +5985,101 @@ namespace tests {
         int fractPartLeadingZerosCount;
         double valueTested;
 
-        BreakFractionToIntAndFracPart(valueTested = 0, &inPart, &fractPart, &fractPartLeadingZerosCount);
+        BreakFractionToIntAndFracPart(CalculatorState::FromDouble(valueTested = 0), &inPart, &fractPart, &fractPartLeadingZerosCount);
         asserts(valueTested, 0, inPart, 0, fractPart);
 
-        BreakFractionToIntAndFracPart(valueTested = 7, &inPart, &fractPart, &fractPartLeadingZerosCount);
+        BreakFractionToIntAndFracPart(CalculatorState::FromDouble(valueTested = 7), &inPart, &fractPart, &fractPartLeadingZerosCount);
         asserts(valueTested, 7, inPart, 0, fractPart);
 
-        BreakFractionToIntAndFracPart(valueTested = 1.1, &inPart, &fractPart, &fractPartLeadingZerosCount);
+        BreakFractionToIntAndFracPart(CalculatorState::FromDouble(valueTested = 1.1), &inPart, &fractPart, &fractPartLeadingZerosCount);
         asserts(valueTested, 1, inPart, 1, fractPart);
 
-        BreakFractionToIntAndFracPart(valueTested = 1.12, &inPart, &fractPart, &fractPartLeadingZerosCount);
+        BreakFractionToIntAndFracPart(CalculatorState::FromDouble(valueTested = 1.12), &inPart, &fractPart, &fractPartLeadingZerosCount);
         asserts(valueTested, 1, inPart, 12, fractPart);
 
-        BreakFractionToIntAndFracPart(valueTested = 12.12, &inPart, &fractPart, &fractPartLeadingZerosCount);
+        BreakFractionToIntAndFracPart(CalculatorState::FromDouble(valueTested = 12.12), &inPart, &fractPart, &fractPartLeadingZerosCount);
         asserts(valueTested, 12, inPart, 12, fractPart);
 
-        BreakFractionToIntAndFracPart(valueTested = 123.123, &inPart, &fractPart, &fractPartLeadingZerosCount);
+        BreakFractionToIntAndFracPart(CalculatorState::FromDouble(valueTested = 123.123), &inPart, &fractPart, &fractPartLeadingZerosCount);
         asserts(valueTested, 123, inPart, 123, fractPart);
 
-        BreakFractionToIntAndFracPart(valueTested = 123.03, &inPart, &fractPart, &fractPartLeadingZerosCount);
+        BreakFractionToIntAndFracPart(CalculatorState::FromDouble(valueTested = 123.03), &inPart, &fractPart, &fractPartLeadingZerosCount);
         asserts(valueTested, 123, inPart, 3, fractPart);
         asserts(valueTested, 1, fractPartLeadingZerosCount);
 
-        BreakFractionToIntAndFracPart(valueTested = 123.103, &inPart, &fractPart, &fractPartLeadingZerosCount);
+        BreakFractionToIntAndFracPart(CalculatorState::FromDouble(valueTested = 123.103), &inPart, &fractPart, &fractPartLeadingZerosCount);
         asserts(valueTested, 123, inPart, 103, fractPart);
         asserts(valueTested, 0, fractPartLeadingZerosCount);
 
-        BreakFractionToIntAndFracPart(valueTested = 123.003, &inPart, &fractPart, &fractPartLeadingZerosCount);
+        BreakFractionToIntAndFracPart(CalculatorState::FromDouble(valueTested = 123.003), &inPart, &fractPart, &fractPartLeadingZerosCount);
         asserts(valueTested, 123, inPart, 3, fractPart);
         asserts(valueTested, 2, fractPartLeadingZerosCount);
 
-        BreakFractionToIntAndFracPart(valueTested = 123.1003, &inPart, &fractPart, &fractPartLeadingZerosCount);
+        BreakFractionToIntAndFracPart(CalculatorState::FromDouble(valueTested = 123.1003), &inPart, &fractPart, &fractPartLeadingZerosCount);
         asserts(valueTested, 123, inPart, 1003, fractPart);
         asserts(valueTested, 0, fractPartLeadingZerosCount);
 
-        BreakFractionToIntAndFracPart(valueTested = 123.0003, &inPart, &fractPart, &fractPartLeadingZerosCount);
+        BreakFractionToIntAndFracPart(CalculatorState::FromDouble(valueTested = 123.0003), &inPart, &fractPart, &fractPartLeadingZerosCount);
         asserts(valueTested, 123, inPart, 3, fractPart);
         asserts(valueTested, 3, fractPartLeadingZerosCount);
 
-        BreakFractionToIntAndFracPart(valueTested = 1234.1234, &inPart, &fractPart, &fractPartLeadingZerosCount);
+        BreakFractionToIntAndFracPart(CalculatorState::FromDouble(valueTested = 1234.1234), &inPart, &fractPart, &fractPartLeadingZerosCount);
         asserts(valueTested, 1234, inPart, 1234, fractPart);
         asserts(valueTested, 0, fractPartLeadingZerosCount);
 
-        BreakFractionToIntAndFracPart(valueTested = 12345.12345, &inPart, &fractPart, &fractPartLeadingZerosCount);
+        BreakFractionToIntAndFracPart(CalculatorState::FromDouble(valueTested = 12345.12345), &inPart, &fractPart, &fractPartLeadingZerosCount);
         asserts(valueTested, 12345, inPart, 12345, fractPart);
         asserts(valueTested, 0, fractPartLeadingZerosCount);
 
-        BreakFractionToIntAndFracPart(valueTested = 223456.123444, &inPart, &fractPart, &fractPartLeadingZerosCount);
+        BreakFractionToIntAndFracPart(CalculatorState::FromDouble(valueTested = 223456.123444), &inPart, &fractPart, &fractPartLeadingZerosCount);
         asserts(valueTested, 223456, inPart, 1234, fractPart);
 
-        BreakFractionToIntAndFracPart(valueTested = 323456.123456, &inPart, &fractPart, &fractPartLeadingZerosCount);
+        BreakFractionToIntAndFracPart(CalculatorState::FromDouble(valueTested = 323456.123456), &inPart, &fractPart, &fractPartLeadingZerosCount);
         asserts(valueTested, 323456, inPart, 1234, fractPart);
 
-        BreakFractionToIntAndFracPart(valueTested = 4234567.1234567, &inPart, &fractPart, &fractPartLeadingZerosCount);
+        BreakFractionToIntAndFracPart(CalculatorState::FromDouble(valueTested = 4234567.1234567), &inPart, &fractPart, &fractPartLeadingZerosCount);
         asserts(valueTested, 4234567, inPart, 123, fractPart);
 
-        BreakFractionToIntAndFracPart(valueTested = 5234567.1239567, &inPart, &fractPart, &fractPartLeadingZerosCount);
+        BreakFractionToIntAndFracPart(CalculatorState::FromDouble(valueTested = 5234567.1239567), &inPart, &fractPart, &fractPartLeadingZerosCount);
         asserts(valueTested, 5234567, inPart, 123, fractPart);
 
-        BreakFractionToIntAndFracPart(valueTested = 1.123456789, &inPart, &fractPart, &fractPartLeadingZerosCount);
+        BreakFractionToIntAndFracPart(CalculatorState::FromDouble(valueTested = 1.123456789), &inPart, &fractPart, &fractPartLeadingZerosCount);
         asserts(valueTested, 1, inPart, 123456789, fractPart);
 
-        BreakFractionToIntAndFracPart(valueTested = 12.123456789, &inPart, &fractPart, &fractPartLeadingZerosCount);
+        BreakFractionToIntAndFracPart(CalculatorState::FromDouble(valueTested = 12.123456789), &inPart, &fractPart, &fractPartLeadingZerosCount);
         asserts(valueTested, 12, inPart, 12345678, fractPart);
 
-        BreakFractionToIntAndFracPart(valueTested = 123.123456789, &inPart, &fractPart, &fractPartLeadingZerosCount);
+        BreakFractionToIntAndFracPart(CalculatorState::FromDouble(valueTested = 123.123456789), &inPart, &fractPart, &fractPartLeadingZerosCount);
         asserts(valueTested, 123, inPart, 1234567, fractPart);
 
-        BreakFractionToIntAndFracPart(valueTested = 1234.123456789, &inPart, &fractPart, &fractPartLeadingZerosCount);
+        BreakFractionToIntAndFracPart(CalculatorState::FromDouble(valueTested = 1234.123456789), &inPart, &fractPart, &fractPartLeadingZerosCount);
         asserts(valueTested, 1234, inPart, 123456, fractPart);
 
-        BreakFractionToIntAndFracPart(valueTested = 12345.123456789, &inPart, &fractPart, &fractPartLeadingZerosCount);
+        BreakFractionToIntAndFracPart(CalculatorState::FromDouble(valueTested = 12345.123456789), &inPart, &fractPart, &fractPartLeadingZerosCount);
         asserts(valueTested, 12345, inPart, 12345, fractPart);
 
-        BreakFractionToIntAndFracPart(valueTested = 123456.123456789, &inPart, &fractPart, &fractPartLeadingZerosCount);
+        BreakFractionToIntAndFracPart(CalculatorState::FromDouble(valueTested = 123456.123456789), &inPart, &fractPart, &fractPartLeadingZerosCount);
         asserts(valueTested, 123456, inPart, 1234, fractPart);
 
-        BreakFractionToIntAndFracPart(valueTested = 1234567.123456789, &inPart, &fractPart, &fractPartLeadingZerosCount);
+        BreakFractionToIntAndFracPart(CalculatorState::FromDouble(valueTested = 1234567.123456789), &inPart, &fractPart, &fractPartLeadingZerosCount);
         asserts(valueTested, 1234567, inPart, 123, fractPart);
 
-        BreakFractionToIntAndFracPart(valueTested = 1234567.1, &inPart, &fractPart, &fractPartLeadingZerosCount);
+        BreakFractionToIntAndFracPart(CalculatorState::FromDouble(valueTested = 1234567.1), &inPart, &fractPart, &fractPartLeadingZerosCount);
         asserts(valueTested, 1234567, inPart, 1, fractPart);
 
-        BreakFractionToIntAndFracPart(valueTested = 1234567.12, &inPart, &fractPart, &fractPartLeadingZerosCount);
+        BreakFractionToIntAndFracPart(CalculatorState::FromDouble(valueTested = 1234567.12), &inPart, &fractPart, &fractPartLeadingZerosCount);
         asserts(valueTested, 1234567, inPart, 12, fractPart);
 
-        BreakFractionToIntAndFracPart(valueTested = 1234567.123, &inPart, &fractPart, &fractPartLeadingZerosCount);
+        BreakFractionToIntAndFracPart(CalculatorState::FromDouble(valueTested = 1234567.123), &inPart, &fractPart, &fractPartLeadingZerosCount);
         asserts(valueTested, 1234567, inPart, 123, fractPart);
 
-        BreakFractionToIntAndFracPart(valueTested = 1234567.1234, &inPart, &fractPart, &fractPartLeadingZerosCount);
+        BreakFractionToIntAndFracPart(CalculatorState::FromDouble(valueTested = 1234567.1234), &inPart, &fractPart, &fractPartLeadingZerosCount);
         asserts(valueTested, 1234567, inPart, 123, fractPart);
 
-        BreakFractionToIntAndFracPart(valueTested = 1234567.12345, &inPart, &fractPart, &fractPartLeadingZerosCount);
+        BreakFractionToIntAndFracPart(CalculatorState::FromDouble(valueTested = 1234567.12345), &inPart, &fractPart, &fractPartLeadingZerosCount);
         asserts(valueTested, 1234567, inPart, 123, fractPart);
 
-        BreakFractionToIntAndFracPart(valueTested = 1234567.123456, &inPart, &fractPart, &fractPartLeadingZerosCount);
+        BreakFractionToIntAndFracPart(CalculatorState::FromDouble(valueTested = 1234567.123456), &inPart, &fractPart, &fractPartLeadingZerosCount);
         asserts(valueTested, 1234567, inPart, 123, fractPart);
     }
 
@@ -550,24 +6087,24 @@ namespace tests {
         testName = "TestNextStepForNonInt";
 
         double testedValue;
-        double nextValue;
+        CalculatorState nextValue;
 
-        nextValue = NextStepForNonInt(testedValue = 2.5);
+        nextValue = NextStepForNonInt(CalculatorState::FromDouble(testedValue = 2.5));
         asserts(testedValue, 2.5, nextValue);
 
-        nextValue = NextStepForNonInt(testedValue = 12.5);
+        nextValue = NextStepForNonInt(CalculatorState::FromDouble(testedValue = 12.5));
         asserts(testedValue, 12.5 * 5, nextValue);
 
-        nextValue = NextStepForNonInt(testedValue = 123.987);
+        nextValue = NextStepForNonInt(CalculatorState::FromDouble(testedValue = 123.987));
         asserts(testedValue, 123.987 * 987, nextValue);
 
-        nextValue = NextStepForNonInt(testedValue = 123.1);
+        nextValue = NextStepForNonInt(CalculatorState::FromDouble(testedValue = 123.1));
         asserts(testedValue, 123.1 * 31, nextValue);
 
-        nextValue = NextStepForNonInt(testedValue = 123.001);
+        nextValue = NextStepForNonInt(CalculatorState::FromDouble(testedValue = 123.001));
         asserts(testedValue, 123.001 * 3001, nextValue);
 
-        nextValue = NextStepForNonInt(testedValue = 120.001);
+        nextValue = NextStepForNonInt(CalculatorState::FromDouble(testedValue = 120.001));
         asserts(testedValue, 120.001 * 20001, nextValue);
     }
 
@@ -579,18 +6116,879 @@ namespace tests {
 
         results = Play(valueTested = 9922);
         expectedFinalValue = (9922.0 / 22) / 51;
-        asserts(valueTested, GameResults{ valueTested, GameOutcome::finished, 2, std::optional<double> { expectedFinalValue } }, results);
+        asserts(valueTested, GameResults{ valueTested, GameOutcome::finished, 2, std::optional<CalculatorState> { CalculatorState::FromDouble(expectedFinalValue) } }, results);
 
         results = Play(valueTested = 9122);
         asserts(valueTested, GameResults{ valueTested, GameOutcome::overflow, 4, std::nullopt }, results);
+
+        results = Play(valueTested = 5816);
+        asserts(valueTested, results.outcome == GameOutcome::cycle, results.stepsCount, results.cycleEntryStep + results.cycleLength);
+        CalculatorState state = CalculatorState::FromInt(valueTested);
+        for (int i = 0; i < results.cycleEntryStep; i++) {
+            state = NextStep(state);
+        }
+        asserts(valueTested, results.finalValue == state, results.cycleEntryStep, results.cycleEntryStep);
+        int returnsAfter = 0;
+        do {
+            state = NextStep(state);
+            returnsAfter++;
+        } while (state != *results.finalValue && returnsAfter <= MaxMoves);
+        asserts(valueTested, true, returnsAfter, results.cycleLength);
+    }
+
+    void TestSweepStats() {
+        testName = "TestSweepStats";
+        uint64_t valueTested = 5000;
+
+        OverallStats expected;
+        for (uint64_t n = 10; n <= valueTested; n++) {
+            expected.AddRun(Play(n));
+        }
+
+        SweepOptions options;
+        options.threadCount = 4;
+        options.chunkSize = 37;
+        asserts(valueTested, expected, SweepStats(10, valueTested, options));
+
+        options.threadCount = 1;
+        options.chunkSize = valueTested;
+        asserts(valueTested, expected, SweepStats(10, valueTested, options));
+    }
+
+    void TestOverallStats() {
+        testName = "TestOverallStats";
+        OverallStats stats;
+        OverallStats firstHalf;
+        OverallStats secondHalf;
+        for (int steps = 1; steps <= 100; steps++) {
+            GameResults results(steps, GameOutcome::finished, steps, CalculatorState::FromInt(steps % 10));
+            (steps <= 50 ? firstHalf : secondHalf).AddRun(GameResults(results));
+            stats.AddRun(std::move(results));
+        }
+        stats.AddRun(GameResults(7, GameOutcome::overflow, 3, std::nullopt));
+        secondHalf.AddRun(GameResults(7, GameOutcome::overflow, 3, std::nullopt));
+
+        const OutcomeStats& finished = stats.GetOutcomeStats(GameOutcome::finished);
+        asserts(100, finished.GetTotalRuns() == 100, finished.GetStepsPercentile(0.5), 50);
+        asserts(100, finished.GetStepsPercentile(0.99) == 99, finished.GetMaxSteps(), 100);
+        asserts(100, stats.GetFinishedOn(0) == 10, stats.GetFinishedOn(7), 10);
+        asserts(101, stats.GetTotalGames() == 101, stats.GetOutcomeStats(GameOutcome::overflow).GetMaxSteps(), 3);
+
+        firstHalf.Merge(secondHalf);
+        asserts(101, stats, firstHalf);
+        std::stringstream serialized;
+        stats.Serialize(serialized);
+        OverallStats deserialized;
+        asserts(101, deserialized.Deserialize(serialized), 0, 0);
+        asserts(101, stats, deserialized);
+    }
+
+    void TestFindLargestWinners() {
+        testName = "TestFindLargestWinners";
+        uint64_t valueTested = 9999;
+
+        std::vector<uint64_t> expected;
+        for (uint64_t n = valueTested; n > 10 && expected.size() < 25; n--) {
+            if (Play(n).outcome == GameOutcome::finished) {
+                expected.push_back(n);
+            }
+        }
+
+        WinnerSearchOptions options;
+        options.threadCount = 3;
+        options.blockSize = 7;
+        std::vector<uint64_t> actual = FindLargestWinners(11, valueTested, expected.size(), options);
+        asserts(valueTested, actual == expected, actual.size(), expected.size());
+
+        std::optional<uint64_t> largest = FindLargestWinner(11, valueTested, options);
+        asserts(valueTested, largest.has_value(), largest.value_or(0), expected.front());
+
+        std::vector<uint64_t> belowLast = FindLargestWinners(11, expected.back() - 1, 1, options);
+        asserts(valueTested, belowLast.size() == 1 && belowLast.front() < expected.back(), belowLast.size(), 1);
+
+        valueTested = 9122;
+        bool isWinner = Play(valueTested).outcome == GameOutcome::finished;
+        asserts(valueTested, FindLargestWinner(valueTested, valueTested, options).has_value() == isWinner, 0, 0);
+    }
+
+    void TestTrajectoryCache() {
+        testName = "TestTrajectoryCache";
+        uint64_t valueTested;
+
+        TrajectoryCache cache(1 << 12);
+        for (valueTested = 10; valueTested <= 10000; valueTested++) {
+            asserts(valueTested, Play(valueTested), Play(valueTested, &cache));
+        }
+        asserts(valueTested, cache.GetHits() > 0, cache.GetHits() + cache.GetMisses() > 0, true);
+
+        TrajectoryCache sharedCache(1 << 20);
+        SweepOptions options;
+        options.threadCount = 4;
+        options.chunkSize = 101;
+        options.cache = &sharedCache;
+        asserts(valueTested, SweepStats(10, valueTested), SweepStats(10, valueTested, options));
+    }
+
+    void TestPlayBatch() {
+        testName = "TestPlayBatch";
+        std::vector<uint64_t> startValues;
+        for (uint64_t n = 0; n <= 20000; n++) {
+            startValues.push_back(n);
+        }
+        for (uint64_t n = 1000000000; n <= 1000020000; n++) {
+            startValues.push_back(n);
+        }
+        for (uint64_t n = MaxCalculatorIntValue - 2000; n <= MaxCalculatorIntValue + 10; n++) {
+            startValues.push_back(n);
+        }
+
+        std::vector<GameResults> expected(startValues.size());
+        std::vector<GameResults> actual(startValues.size());
+        PlayBatchScalar(startValues.data(), startValues.size(), expected.data());
+        PlayBatch(startValues.data(), startValues.size(), actual.data());
+        for (size_t i = 0; i < startValues.size(); i++) {
+            asserts(startValues[i], expected[i], actual[i]);
+        }
+    }
+
+    void TestDigitTables() {
+        testName = "TestDigitTables";
+        std::vector<uint64_t> valuesTested;
+        for (uint64_t n = 10; n <= 300000; n++) {
+            valuesTested.push_back(n);
+        }
+        std::mt19937_64 random(2024);
+        std::uniform_int_distribution<uint64_t> distribution(10, MaxCalculatorIntValue);
+        for (int i = 0; i < 200000; i++) {
+            valuesTested.push_back(distribution(random));
+        }
+        for (int digits = 2; digits <= DigitsInCalculator; digits++) {
+            valuesTested.push_back(PowersOfTen[digits - 1]);
+            valuesTested.push_back(PowersOfTen[digits - 1] + 1);
+            valuesTested.push_back(PowersOfTen[digits] - 1);
+        }
+
+        for (uint64_t n : valuesTested) {
+            uint64_t expectedValue = 0;
+            uint64_t actualValue = 0;
+            bool expected = HasTwoRepeatingDigitsByLoop(n, &expectedValue);
+            bool actual = HasTwoRepeatingDigits(n, &actualValue);
+            asserts(n, expected == actual, actualValue, expectedValue);
+            asserts(n, SuffixDivisorByLoop(n), SuffixDivisor(n), expectedValue, actualValue);
+        }
+    }
+
+    void TestBenchmarkCompare() {
+        testName = "TestBenchmarkCompare";
+        const std::string path = GetTestTempPath("CalcGameTestBenchmarks.json");
+        BenchmarkOptions options;
+        std::vector<BenchmarkResult> written = {
+            { "Play/digits:4", 4096, 250.5, 3.25, 245, true },
+            { "NextStepForInt/digits:4", 4096, 12.125, 0.5, 11.75, false },
+        };
+        {
+            std::ofstream out(path);
+            WriteBenchmarkJson(out, options, written);
+        }
+        std::map<std::string, BenchmarkResult> baseline;
+        const bool read = ReadBenchmarkJson(path, &baseline);
+        asserts(0, read, baseline.size(), written.size());
+        for (const BenchmarkResult& result : written) {
+            const BenchmarkResult& readBack = baseline[result.name];
+            asserts(result.nsPerOp, readBack.ops == result.ops && readBack.stddevNsPerOp == result.stddevNsPerOp
+                && readBack.minNsPerOp == result.minNsPerOp, 0, 0);
+            asserts(result.nsPerOp, result.nsPerOp, readBack.nsPerOp);
+        }
+
+        std::ostringstream report;
+        std::map<std::string, BenchmarkResult> current = baseline;
+        asserts(0, CompareBenchmarks(report, baseline, current, 5), 0, 0);
+        current["Play/digits:4"].nsPerOp = 300;
+        asserts(300, !CompareBenchmarks(report, baseline, current, 5), 0, 0);
+        // within the noise of the baseline
+        current["Play/digits:4"].nsPerOp = 256;
+        asserts(256, CompareBenchmarks(report, baseline, current, 1), 0, 0);
+        current["Play/digits:4"].nsPerOp = 250.5;
+        baseline["NextStepForInt/digits:4"].nsPerOp = 0;
+        asserts(0, !CompareBenchmarks(report, baseline, current, 5), 0, 0);
+
+        written[1].nsPerOp = 0;
+        {
+            std::ofstream out(path);
+            WriteBenchmarkJson(out, options, written);
+        }
+        std::map<std::string, BenchmarkResult> zeroBaseline;
+        asserts(0, !ReadBenchmarkJson(path, &zeroBaseline), 0, 0);
+        std::filesystem::remove(path);
+    }
+
+    void TestResultsFile() {
+        testName = "TestResultsFile";
+        const std::string path = GetTestTempPath("CalcGameTestResults");
+        const uint64_t lo = 10;
+        const uint64_t hi = 6000;
+        ResultsFileWriter writer;
+        asserts(lo, writer.Create(path, lo, hi, 256), 0, 0);
+        SweepOptions options;
+        options.threadCount = 3;
+        options.resultsWriter = &writer;
+        asserts(hi, SweepStats(lo, hi), SweepStats(lo, hi, options));
+        asserts(hi, writer.Close(), 0, 0);
+
+        ResultsFileReader reader;
+        asserts(lo, reader.Open(path), 0, 0);
+        GameResults results;
+        for (uint64_t valueTested = lo; valueTested <= hi; valueTested++) {
+            asserts(valueTested, reader.Lookup(valueTested, &results), 0, 0);
+            asserts(valueTested, Play(valueTested), results);
+        }
+        asserts(lo - 1, !reader.Lookup(lo - 1, &results), 0, 0);
+        asserts(hi + 1, !reader.Lookup(hi + 1, &results), 0, 0);
+
+        // record ranks are 16 bits, larger blocks would wrap them
+        const std::string largePath = GetTestTempPath("CalcGameTestResultsLarge");
+        ResultsFileWriter largeBlocks;
+        asserts(ResultsFileHeader::MaxBlockSize, largeBlocks.Create(largePath, lo, hi, ResultsFileHeader::MaxBlockSize), 0, 0);
+        asserts(ResultsFileHeader::MaxBlockSize, largeBlocks.Close(), 0, 0);
+        asserts(ResultsFileHeader::MaxBlockSize + 64, !largeBlocks.Create(largePath, lo, hi, ResultsFileHeader::MaxBlockSize + 64), 0, 0);
+        ResultsFileHeader header;
+        header.blockSize = ResultsFileHeader::MaxBlockSize * 2;
+        header.lo = lo;
+        header.hi = hi;
+        {
+            std::ofstream out(largePath, std::ios::binary);
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            out.write(std::string(64, '\0').data(), 64);
+        }
+        ResultsFileReader largeBlocksReader;
+        asserts(header.blockSize, !largeBlocksReader.Open(largePath), 0, 0);
+        std::filesystem::remove(largePath);
+        std::filesystem::remove(path);
+    }
+
+    void TestSweepCheckpoint() {
+        testName = "TestSweepCheckpoint";
+        const std::string path = GetTestTempPath("CalcGameTestCheckpoint");
+        const uint64_t lo = 10;
+        const uint64_t hi = 20000;
+        const uint64_t chunkSize = 512;
+
+        // a checkpoint of an interrupted sweep that got through every other chunk
+        SweepProgress interrupted;
+        interrupted.Reset(lo, hi, chunkSize);
+        for (uint64_t chunk = 0; chunk < interrupted.GetChunkCount(); chunk += 2) {
+            uint64_t chunkLo = lo + chunk * chunkSize;
+            uint64_t chunkHi = std::min(hi, chunkLo + chunkSize - 1);
+            interrupted.AddChunk(chunk, SweepStats(chunkLo, chunkHi), FindLargestWinners(chunkLo, chunkHi, SweepWinnersKept));
+        }
+        asserts(hi, interrupted.Save(path), 0, 0);
+
+        SweepOptions options;
+        options.threadCount = 3;
+        options.chunkSize = chunkSize;
+        CheckpointOptions checkpoint;
+        checkpoint.path = path;
+        checkpoint.intervalSeconds = 1;
+        SweepProgress resumed;
+        asserts(hi, SweepWithCheckpoints(lo, hi, options, checkpoint, &resumed), 0, 0);
+        asserts(hi, SweepStats(lo, hi), resumed.stats);
+        asserts(hi, resumed.largestWinners == FindLargestWinners(lo, hi, SweepWinnersKept), resumed.GetCompletedChunksCount(), resumed.GetChunkCount());
+
+        SweepProgress loaded;
+        asserts(hi, loaded.Load(path), 0, 0);
+        asserts(hi, resumed.stats, loaded.stats);
+        asserts(hi, loaded.largestWinners == resumed.largestWinners, loaded.GetCompletedChunksCount(), loaded.GetChunkCount());
+
+        options.chunkSize = chunkSize * 2;
+        asserts(hi, !SweepWithCheckpoints(lo, hi, options, checkpoint, &resumed), 0, 0);
+        std::filesystem::remove(path);
+    }
+
+    void TestSweepPipeline() {
+        testName = "TestSweepPipeline";
+        // every value pushed by 3 producers through a queue of 4 is popped once by 3 consumers
+        const uint64_t valuesPerProducer = 20000;
+        BoundedMpmcQueue<uint64_t> queue(3);
+        std::atomic<uint64_t> popped(0);
+        std::atomic<uint64_t> poppedSum(0);
+        std::vector<std::thread> threads;
+        for (uint64_t producer = 0; producer < 3; producer++) {
+            threads.emplace_back([&, producer]() {
+                for (uint64_t value = 1; value <= valuesPerProducer; value++) {
+                    queue.Push(value + producer * valuesPerProducer);
+                }
+            });
+            threads.emplace_back([&]() {
+                for (uint64_t value; popped.fetch_add(1) < 3 * valuesPerProducer; ) {
+                    queue.Pop(&value);
+                    poppedSum += value;
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        uint64_t value;
+        const uint64_t count = 3 * valuesPerProducer;
+        asserts(count, !queue.TryPop(&value), poppedSum.load(), count * (count + 1) / 2);
+
+        SweepOptions options;
+        options.threadCount = 3;
+        options.chunkSize = 512;
+        PipelineOptions pipeline;
+        pipeline.queueBatches = 2;
+        pipeline.progressSeconds = 1e-9;
+        std::vector<PipelineProgress> reports;
+        pipeline.report = [&](const PipelineProgress& progress) { reports.push_back(progress); };
+        const uint64_t lo = 10;
+        const uint64_t hi = 20000;
+        const OverallStats stats = SweepPipelined(lo, hi, options, pipeline);
+        asserts(hi, SweepStats(lo, hi), stats);
+        asserts(hi, !reports.empty(), reports.back().gamesDone, hi - lo + 1);
+        asserts(hi, true, reports.back().totalGames, hi - lo + 1);
+    }
+
+    void TestStratifiedSampling() {
+        testName = "TestStratifiedSampling";
+        // strata no larger than their share of a round are played through, so small ranges come out exact
+        const OverallStats stats = SweepStats(10, 9999);
+        const SampledStats exact = SampleStats(10, 9999);
+        asserts(9999, exact.exhaustive, exact.gamesPlayed, stats.GetTotalGames());
+        for (const auto gameOutcome : AllGameOutcomes) {
+            const OutcomeStats& outcomeStats = stats.GetOutcomeStats(gameOutcome);
+            const SampleEstimate& share = exact.outcomeShare[static_cast<size_t>(gameOutcome)];
+            const SampleEstimate& steps = exact.avgSteps[static_cast<size_t>(gameOutcome)];
+            asserts(9999, std::abs(share.value - 100.0 * outcomeStats.GetTotalRuns() / stats.GetTotalGames()) < 1e-9
+                && std::abs(steps.value - (outcomeStats.GetTotalRuns() != 0 ? outcomeStats.GetAvgStepsPerGame() : 0)) < 1e-9,
+                0, 0);
+            asserts(9999, share.halfWidth == 0 && steps.halfWidth == 0, 0, 0);
+        }
+
+        // one round of a larger range draws the same games on any thread count and standard library, and its
+        // intervals hold the truth
+        const uint64_t lo = 10;
+        const uint64_t hi = 100000;
+        SamplingOptions options;
+        options.roundGames = 1 << 13;
+        options.maxGames = 1;
+        options.threadCount = 1;
+        const SampledStats sampled = SampleStats(lo, hi, options);
+        options.threadCount = 3;
+        const SampledStats resampled = SampleStats(lo, hi, options);
+        asserts(hi, !sampled.exhaustive, sampled.rounds, 1);
+        const OverallStats rangeStats = SweepStats(lo, hi);
+        for (const auto gameOutcome : { GameOutcome::finished, GameOutcome::overflow }) {
+            const size_t outcome = static_cast<size_t>(gameOutcome);
+            const OutcomeStats& outcomeStats = rangeStats.GetOutcomeStats(gameOutcome);
+            const SampleEstimate& share = sampled.outcomeShare[outcome];
+            const SampleEstimate& steps = sampled.avgSteps[outcome];
+            asserts(hi, std::abs(share.value - 100.0 * outcomeStats.GetTotalRuns() / rangeStats.GetTotalGames()) <= share.halfWidth
+                && std::abs(steps.value - outcomeStats.GetAvgStepsPerGame()) <= steps.halfWidth, 0, 0);
+            asserts(hi, share.value, resampled.outcomeShare[outcome].value);
+            asserts(hi, steps.halfWidth, resampled.avgSteps[outcome].halfWidth);
+        }
+    }
+
+    void TestShardedSweep() {
+        testName = "TestShardedSweep";
+        const uint64_t lo = 10;
+        const uint64_t hi = 20000;
+        const uint64_t chunkSize = 512;
+
+        // the shards of every count tile the range in whole chunks
+        for (uint64_t count = 1; count <= 7; count++) {
+            uint64_t next = lo;
+            for (uint64_t index = 0; index < count; index++) {
+                uint64_t shardLo = 0;
+                uint64_t shardHi = 0;
+                asserts(count, GetShardRange(lo, hi, chunkSize, index, count, &shardLo, &shardHi), 0, 0);
+                asserts(count, (shardLo - lo) % chunkSize == 0, shardLo, next);
+                next = shardHi + 1;
+            }
+            asserts(count, true, next, hi + 1);
+        }
+        uint64_t unusedLo;
+        uint64_t unusedHi;
+        asserts(lo, !GetShardRange(lo, lo + chunkSize, chunkSize, 0, 3, &unusedLo, &unusedHi), 0, 0);
+
+        // three shards saved by separate sweeps merge into the report of the whole range
+        SweepOptions options;
+        options.threadCount = 2;
+        options.chunkSize = chunkSize;
+        std::vector<SweepProgress> shards;
+        for (uint64_t index = 0; index < 3; index++) {
+            const std::string path = GetTestTempPath("CalcGameTestShard" + std::to_string(index) + "_");
+            uint64_t shardLo = 0;
+            uint64_t shardHi = 0;
+            asserts(index, GetShardRange(lo, hi, chunkSize, index, 3, &shardLo, &shardHi), 0, 0);
+            SweepProgress progress;
+            asserts(index, SweepWithCheckpoints(shardLo, shardHi, options, CheckpointOptions(), &progress), 0, 0);
+            asserts(index, progress.Save(path), 0, 0);
+            shards.emplace_back();
+            asserts(index, shards.back().Load(path), 0, 0);
+            std::filesystem::remove(path);
+        }
+        MergedShards merged;
+        asserts(hi, MergeShards(shards, &merged), 0, 0);
+        asserts(hi, SweepStats(lo, hi), merged.stats);
+        asserts(hi, merged.largestWinners == FindLargestWinners(lo, hi, SweepWinnersKept), merged.ranges.size(), 1);
+        asserts(hi, true, merged.ranges[0].second, hi);
+
+        // a missing shard leaves a gap, a repeated one or another rules' shard does not merge
+        asserts(hi, MergeShards({ shards[2], shards[0] }, &merged), 0, 0);
+        asserts(hi, true, merged.ranges.size(), 2);
+        asserts(hi, !MergeShards({ shards[0], shards[1], shards[1] }, &merged), 0, 0);
+        shards[1].rules.twoRepeatingDigitsRule = !shards[1].rules.twoRepeatingDigitsRule;
+        asserts(hi, !MergeShards(shards, &merged), 0, 0);
+    }
+
+    void TestWinnerIndex() {
+        testName = "TestWinnerIndex";
+        const std::string path = GetTestTempPath("CalcGameTestWinners");
+        // spans the block boundary at 65536
+        const uint64_t lo = 63000;
+        const uint64_t hi = 68000;
+        std::vector<uint64_t> winners;
+        for (uint64_t n = lo; n <= hi; n++) {
+            if (Play(n).outcome == GameOutcome::finished) {
+                winners.push_back(n);
+            }
+        }
+        // all array containers, then all bitmaps
+        for (uint32_t arrayMaxCardinality : { WinnerArrayMaxCardinality, 4u }) {
+            WinnerIndex index;
+            asserts(arrayMaxCardinality, BuildWinnerIndex(path, lo, hi, SweepOptions(), arrayMaxCardinality), 0, 0);
+            const bool opened = index.Open(path);
+            asserts(arrayMaxCardinality, opened, index.GetWinnersCount(), winners.size());
+            for (uint64_t n = lo - 3; n <= hi + 3; n++) {
+                const auto after = std::upper_bound(winners.begin(), winners.end(), n);
+                const uint64_t rank = after - winners.begin();
+                asserts(n, index.Contains(n) == std::binary_search(winners.begin(), winners.end(), n), index.Rank(n), rank);
+                uint64_t winner = 0;
+                const bool hasPredecessor = index.Predecessor(n, &winner);
+                asserts(n, hasPredecessor == (rank > 0), hasPredecessor ? winner : 0, rank > 0 ? winners[rank - 1] : 0);
+                const bool hasSuccessor = index.Successor(n, &winner);
+                const auto from = std::lower_bound(winners.begin(), winners.end(), n);
+                asserts(n, hasSuccessor == (from != winners.end()), hasSuccessor ? winner : 0, from != winners.end() ? *from : 0);
+            }
+            for (uint64_t rank = 0; rank <= winners.size(); rank++) {
+                uint64_t winner = 0;
+                const bool selected = index.Select(rank, &winner);
+                asserts(rank, selected == (rank < winners.size()), selected ? winner : 0, rank < winners.size() ? winners[rank] : 0);
+            }
+            asserts(hi, true, index.CountInRange(65000, 66000), std::count_if(winners.begin(), winners.end(),
+                [](uint64_t n) { return n >= 65000 && n <= 66000; }));
+        }
+        std::filesystem::resize_file(path, std::filesystem::file_size(path) - 8);
+        WinnerIndex truncated;
+        asserts(hi, !truncated.Open(path), 0, 0);
+        std::filesystem::remove(path);
+    }
+
+    void TestSummaryIndex() {
+        testName = "TestSummaryIndex";
+        const std::string path = GetTestTempPath("CalcGameTestSummary");
+        // leaves of 256 values four to a node, so that a range goes through every level
+        const uint64_t lo = 10;
+        const uint64_t hi = 20000;
+        asserts(hi, BuildSummaryIndex(path, lo, hi, SweepOptions(), 8, 4), 0, 0);
+        SummaryIndex index;
+        const bool opened = index.Open(path);
+        asserts(hi, opened, index.GetHeader().GetLevelsCount(), 5);
+        const std::pair<uint64_t, uint64_t> ranges[] = { { lo, hi }, { 0, 100000 }, { 10, 10 }, { 255, 256 },
+            { 1000, 1255 }, { 1024, 4095 }, { 300, 19000 }, { 4096, 20000 }, { 7777, 15360 } };
+        for (const auto& range : ranges) {
+            uint64_t gamesPlayed = 0;
+            const RangeSummary summary = index.GetRangeSummary(range.first, range.second, nullptr, &gamesPlayed);
+            const OverallStats stats = SweepStats(std::max(lo, range.first), std::min(hi, range.second));
+            asserts(range.first, gamesPlayed < 512, summary.GetTotalGames(), stats.GetTotalGames());
+            for (const auto gameOutcome : AllGameOutcomes) {
+                const size_t outcome = static_cast<size_t>(gameOutcome) - 1;
+                const OutcomeStats& outcomeStats = stats.GetOutcomeStats(gameOutcome);
+                asserts(range.second, true, summary.games[outcome], outcomeStats.GetTotalRuns());
+                if (outcomeStats.GetTotalRuns() == 0) {
+                    continue;
+                }
+                asserts(range.second, 1.0 * summary.stepsSum[outcome] / summary.games[outcome], outcomeStats.GetAvgStepsPerGame());
+                int low;
+                int high;
+                summary.GetStepsPercentile(gameOutcome, 0.99, &low, &high);
+                const int percentile = outcomeStats.GetStepsPercentile(0.99);
+                asserts(range.second, low <= percentile && percentile <= high, summary.maxSteps[outcome], outcomeStats.GetMaxSteps());
+            }
+            for (int intPart = 0; intPart < 10; intPart++) {
+                asserts(range.second, true, summary.finishedOn[intPart], stats.GetFinishedOn(intPart));
+            }
+        }
+        // a rebuild that cannot be written leaves the old index in place
+        std::filesystem::create_directory(path + ".tmp");
+        asserts(hi, !BuildSummaryIndex(path, lo, 2 * hi, SweepOptions(), 8, 4), 0, 0);
+        std::filesystem::remove(path + ".tmp");
+        SummaryIndex kept;
+        const bool keptOpened = kept.Open(path);
+        asserts(hi, keptOpened, kept.GetHeader().hi, hi);
+
+        // leaves of 2^32 values would overflow their 32-bit game counts
+        asserts(hi, !BuildSummaryIndex(path, lo, hi, SweepOptions(), MaxSummaryLeafBits + 1, 4), 0, 0);
+        {
+            std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+            const uint32_t leafBits = MaxSummaryLeafBits + 1;
+            file.seekp(offsetof(SummaryIndexHeader, leafBits));
+            file.write(reinterpret_cast<const char*>(&leafBits), sizeof(leafBits));
+        }
+        SummaryIndex wideLeaves;
+        asserts(hi, !wideLeaves.Open(path), 0, 0);
+
+        std::filesystem::resize_file(path, std::filesystem::file_size(path) - 8);
+        SummaryIndex truncated;
+        asserts(hi, !truncated.Open(path), 0, 0);
+        std::filesystem::remove(path);
+    }
+
+    void TestSmallValueTable() {
+        testName = "TestSmallValueTable";
+        const std::string path = GetTestTempPath("CalcGameTestSmallTable");
+        const uint64_t bound = 5000;
+        std::vector<GameResults> expected;
+        for (uint64_t n = 0; n < 6 * bound; n += 3) {
+            expected.push_back(Play(n));
+        }
+        asserts(bound, BuildSmallValueTable(path, bound, 2), 0, 0);
+        const bool loaded = LoadSmallValueTable(path);
+        asserts(bound, loaded, SmallValueTableBound, bound);
+        // games below the bound are a lookup, the rest finish with one once they get there
+        std::vector<uint64_t> startValues;
+        for (uint64_t n = 0; n < 6 * bound; n += 3) {
+            asserts(n, expected[n / 3], Play(n));
+            startValues.push_back(n);
+        }
+        // the batch kernel retires its lanes there too
+        std::vector<GameResults> batchResults(startValues.size());
+        PlayBatch(startValues.data(), startValues.size(), batchResults.data());
+        for (size_t i = 0; i < startValues.size(); i++) {
+            asserts(startValues[i], expected[i], batchResults[i]);
+        }
+        TrajectoryRecorder recorder;
+        asserts(9922, Play(9922), Play(9922, nullptr, &recorder));
+        asserts(9922, true, recorder.GetStepsCount(), 3);
+
+        // a table must start at 0 and hold the default rules
+        ResultsFileWriter writer;
+        const bool rejected = writer.Create(path, 10, bound) && writer.Close() && !LoadSmallValueTable(path);
+        asserts(bound, rejected, SmallValueTableBound, 0);
+        const bool unloaded = LoadSmallValueTable("");
+        asserts(bound, unloaded, SmallValueTableBound, 0);
+        std::filesystem::remove(path);
+    }
+
+    void TestGameRules() {
+        testName = "TestGameRules";
+        using Wide = GameRules<16, true, 1000>;
+        uint64_t valueTested;
+
+        for (valueTested = 10; valueTested <= 3000; valueTested++) {
+            GameResults results;
+            asserts(valueTested, VisitRules(RulesVariant(), [&](auto rules) { results = Play<decltype(rules)>(valueTested); }), 0, 0);
+            asserts(valueTested, Play(valueTested), results);
+        }
+        asserts(valueTested, !VisitRules(RulesVariant{ 11, true, 1000 }, [](auto) {}), 0, 0);
+
+        GameResults results = Play<GameRules<8, true, 1000>>(valueTested = 9922);
+        asserts(valueTested, results.finalValue == CalculatorState{ 88431372, 7 }, results.stepsCount, 2);
+        results = Play<GameRules<12, true, 1000>>(valueTested = 9922);
+        asserts(valueTested, results.finalValue == CalculatorState{ 88431372549, 10 }, results.stepsCount, 2);
+        results = Play<Wide>(valueTested = 9922);
+        asserts(valueTested, results.finalValue == CalculatorState{ 884313725490196, 14 }, results.stepsCount, 2);
+
+        // products past 64 bits
+        CalculatorState res = Divide<Wide>(valueTested = 9999999999999999, 12345678901);
+        asserts(valueTested, res == CalculatorState{ 8100000073053899, 10 }, 0, 0);
+        res = Multiply<Wide>(CalculatorState{ 1234567890123456, 15 }, valueTested = 1234567890123);
+        asserts(valueTested, res == CalculatorState{ 1524157875323318, 3 }, 0, 0);
+        res = Multiply<Wide>(CalculatorState{ 1234567890123456, 15 }, valueTested = 9000000000000000);
+        asserts(valueTested, res.IsOverflow(), 0, 0);
+
+        std::mt19937_64 random(16);
+        std::uniform_int_distribution<uint64_t> distribution(10, Wide::MaxIntValue);
+        for (int i = 0; i < 100000; i++) {
+            valueTested = distribution(random);
+            uint64_t expectedValue = 0;
+            uint64_t actualValue = 0;
+            bool expected = HasTwoRepeatingDigitsByLoop(valueTested, &expectedValue, Wide::MaxIntValue);
+            bool actual = HasTwoRepeatingDigits<Wide>(valueTested, &actualValue);
+            asserts(valueTested, expected == actual, actualValue, expectedValue);
+            asserts(valueTested, true, SuffixDivisor(valueTested), SuffixDivisorByLoop(valueTested));
+        }
+    }
+
+    template <typename Rules>
+    void CheckWinnersBackward(uint64_t lo, uint64_t hi, int maxSteps = INT32_MAX) {
+        BackwardSearchOptions options;
+        options.maxSteps = maxSteps;
+        std::vector<GameResults> winners = FindWinnersBackward<Rules>(lo, hi, &options);
+        size_t winner = 0;
+        for (uint64_t valueTested = lo; valueTested <= hi; valueTested++) {
+            GameResults results = Play<Rules>(valueTested);
+            if (results.outcome == GameOutcome::finished && results.stepsCount <= maxSteps) {
+                asserts(valueTested, winner < winners.size(), 0, 0);
+                asserts(valueTested, winners[std::min(winner, winners.size() - 1)], results);
+                winner++;
+            }
+        }
+        asserts(hi, true, winners.size(), winner);
+    }
+
+    void TestBackwardSearch() {
+        testName = "TestBackwardSearch";
+        uint64_t valueTested;
+
+        std::vector<CalculatorState> predecessors = FindPredecessors(CalculatorState{ 451, 0 });
+        asserts(valueTested = 451, std::count(predecessors.begin(), predecessors.end(), CalculatorState{ 9922, 0 }) == 1, 0, 0);
+        for (const CalculatorState& predecessor : predecessors) {
+            asserts(predecessor.digits, NextStep(predecessor) == CalculatorState{ 451, 0 }, 0, 0);
+        }
+
+        // every step of sampled games is found again from the state it leads to
+        std::mt19937_64 random(13);
+        std::uniform_int_distribution<uint64_t> distribution(10, MaxCalculatorIntValue);
+        for (int i = 0; i < 50; i++) {
+            CalculatorState n = CalculatorState::FromInt(valueTested = distribution(random));
+            for (int step = 0; step < 4 && n.GetIntPart() >= 10 && !n.IsOverflow(); step++) {
+                CalculatorState next = NextStep(n);
+                if (!next.IsOverflow()) {
+                    predecessors = FindPredecessors(next);
+                    asserts(valueTested, std::count(predecessors.begin(), predecessors.end(), n) == 1, 0, 0);
+                }
+                n = next;
+            }
+        }
+
+        CheckWinnersBackward<GameRules<4, true, 1000>>(0, 9999);
+        CheckWinnersBackward<GameRules<4, false, 1000>>(0, 9999);
+        CheckWinnersBackward<DefaultRules>(9990000000, 9990100000, 1);
+    }
+
+    void TestQueryEngine() {
+        testName = "TestQueryEngine";
+        const std::string path = GetTestTempPath("CalcGameTestQueryResults");
+        const uint64_t storedLo = 4000;
+        const uint64_t storedHi = 9000;
+        ResultsFileWriter writer;
+        asserts(storedLo, writer.Create(path, storedLo, storedHi, 512), 0, 0);
+        SweepOptions options;
+        options.resultsWriter = &writer;
+        SweepStats(storedLo, storedHi, options);
+        asserts(storedHi, writer.Close(), 0, 0);
+
+        std::vector<uint64_t> startValues = { 5816, 10, 9922, 3999, 4000, 9000, 9001, 9999997912, 7, 6543 };
+        QueryEngine plainEngine(2);
+        QueryEngine storedEngine(2);
+        asserts(storedLo, storedEngine.OpenResults(path), 0, 0);
+        for (QueryEngine* engine : { &plainEngine, &storedEngine }) {
+            std::vector<GameResults> results(startValues.size());
+            engine->PlayBatch(startValues.data(), startValues.size(), results.data());
+            for (size_t i = 0; i < startValues.size(); i++) {
+                asserts(startValues[i], Play(startValues[i]), results[i]);
+            }
+            asserts(storedLo, SweepStats(3000, 12000), engine->GetRangeStats(3000, 12000));
+            asserts(storedLo, SweepStats(5000, 6000), engine->GetRangeStats(5000, 6000));
+            asserts(storedLo, true, engine->GetPlayedCount(3000, 12000), engine == &plainEngine ? 9001 : 4000);
+            asserts(storedLo, IsServableQueryRange(*engine, 3000, 12000) && !IsServableQueryRange(*engine, 12000, 3000), 0, 0);
+            std::vector<uint64_t> winners = engine->GetLargestWinners(3000, 9500, 40);
+            asserts(storedLo, winners == FindLargestWinners(3000, 9500, 40), winners.size(), 40);
+        }
+
+#ifndef _WIN32
+        const std::string socketPath = GetTestTempPath("CalcGameTestQuerySocket");
+        QueryServer server(storedEngine);
+        asserts(storedLo, server.Listen(socketPath), 0, 0);
+        std::thread serving([&]() { server.Run(); });
+        QueryClient clients[2];
+        for (QueryClient& client : clients) {
+            asserts(storedLo, client.Connect(socketPath), 0, 0);
+        }
+        std::vector<GameResults> results[2];
+        std::thread other([&]() { clients[1].Play(startValues.data() + 5, 5, &results[1]); });
+        asserts(storedLo, clients[0].Play(startValues.data(), 5, &results[0]), 0, 0);
+        other.join();
+        for (size_t i = 0; i < startValues.size(); i++) {
+            asserts(startValues[i], results[i / 5].size() == 5, 0, 0);
+            asserts(startValues[i], Play(startValues[i]), results[i / 5][i % 5]);
+        }
+        OverallStats stats;
+        asserts(storedLo, clients[0].GetRangeStats(3000, 12000, &stats), 0, 0);
+        asserts(storedLo, SweepStats(3000, 12000), stats);
+        std::vector<uint64_t> winners;
+        asserts(storedLo, clients[1].GetLargestWinners(3000, 9500, 40, &winners), 0, 0);
+        asserts(storedLo, winners == FindLargestWinners(3000, 9500, 40), winners.size(), 40);
+        asserts(storedLo, !clients[1].GetRangeStats(12000, 3000, &stats), 0, 0);
+        asserts(storedLo, clients[1].GetRangeStats(10, 20, &stats), 0, 0);
+        // ranges that would keep the poll thread busy are turned away
+        asserts(storedLo, !clients[1].GetRangeStats(10, MaxCalculatorIntValue, &stats), 0, 0);
+        asserts(storedLo, !clients[1].GetLargestWinners(10, MaxCalculatorIntValue, 1, &winners), 0, 0);
+        asserts(storedHi, !clients[0].GetRangeStats(storedLo, storedHi + MaxQueryPlayedValues + 1, &stats), 0, 0);
+        // as are play requests whose reply would not fit in a frame, and the connection stays usable
+        const std::vector<uint64_t> manyStartValues(MaxQueryPlayValues + 1, 5816);
+        asserts(MaxQueryPlayValues, !clients[0].Play(manyStartValues.data(), manyStartValues.size(), &results[0]), 0, 0);
+        const bool playedAfter = clients[0].Play(startValues.data(), 5, &results[0]);
+        asserts(MaxQueryPlayValues, playedAfter, results[0].size(), 5);
+        server.Stop();
+        serving.join();
+#endif
+
+        // a range the file covers is still read game by game, so its length is capped as well
+        const std::string sparsePath = GetTestTempPath("CalcGameTestQuerySparse");
+        ResultsFileWriter sparseWriter;
+        asserts(MaxQueryRangeValues, sparseWriter.Create(sparsePath, 0, MaxQueryRangeValues) && sparseWriter.Close(), 0, 0);
+        QueryEngine sparseEngine(1);
+        const bool sparseOpened = sparseEngine.OpenResults(sparsePath);
+        asserts(MaxQueryRangeValues, sparseOpened, sparseEngine.GetPlayedCount(0, MaxQueryRangeValues), 0);
+        asserts(MaxQueryRangeValues, IsServableQueryRange(sparseEngine, 0, MaxQueryRangeValues - 1)
+            && !IsServableQueryRange(sparseEngine, 0, MaxQueryRangeValues), 0, 0);
+        std::filesystem::remove(sparsePath);
+        std::filesystem::remove(path);
+    }
+
+    void TestTrajectoryRecorder() {
+        testName = "TestTrajectoryRecorder";
+        TrajectoryRecorder recorder;
+        for (uint64_t valueTested : { 9122ull, 9922ull, 5816ull, 7ull, 1000000000ull, 9999997912ull }) {
+            GameResults results = Play(valueTested, nullptr, &recorder);
+            asserts(valueTested, Play(valueTested), results);
+            const TrajectoryStep* steps = recorder.GetSteps();
+            size_t count = recorder.GetStepsCount();
+            asserts(valueTested, count > 0 && steps[0].GetState() == CalculatorState{ valueTested, 0 }, 0, 0);
+            asserts(valueTested, steps[count - 1].rule == StepRule::none, 0, 0);
+            for (size_t i = 0; i + 1 < count; i++) {
+                StepRule rule;
+                asserts(valueTested, GetStepOperand(steps[i].GetState(), &rule) == steps[i].operand && rule == steps[i].rule, 0, 0);
+                asserts(valueTested, NextStep(steps[i].GetState()) == steps[i + 1].GetState(), i, i);
+            }
+            if (results.outcome != GameOutcome::cycle) {
+                asserts(valueTested, true, count, results.stepsCount + 1);
+            }
+            asserts(valueTested, true, recorder.IsTruncated(), 0);
+        }
+
+        std::ostringstream out;
+        WriteTrajectory(out, Play(9922, nullptr, &recorder), recorder);
+        asserts(9922, out.str() == "9922 finished 2: 9922 r22 451 s51 8.843137254\n", 0, 0);
+        out.str("");
+        WriteTrajectory(out, Play(9122, nullptr, &recorder), recorder);
+        asserts(9122, out.str() == "9122 overflow 4: 9122 s2 4561 s61 74.7704918 m7704918 576100508.1 m81 overflow\n", 0, 0);
+
+        // a game longer than the arena keeps its first steps
+        TrajectoryRecorder shortRecorder(3);
+        Play(9122, nullptr, &shortRecorder);
+        asserts(9122, shortRecorder.IsTruncated(), shortRecorder.GetStepsCount(), 4);
+
+        out.str("");
+        WriteTrajectories(out, 5000, 9000, [](const GameResults& results) { return results.outcome == GameOutcome::cycle; }, 2);
+        asserts(5816, out.str().rfind("5816 cycle 136: 5816 s6 969.3333333 m3333333 ", 0) == 0, 0, 0);
+        std::string expected;
+        for (uint64_t valueTested = 5000; valueTested <= 9000; valueTested++) {
+            std::ostringstream line;
+            if (Play(valueTested).outcome == GameOutcome::cycle) {
+                WriteTrajectory(line, Play(valueTested, nullptr, &recorder), recorder);
+            }
+            expected += line.str();
+        }
+        asserts(9000, out.str() == expected, 0, 0);
+    }
+
+    void TestDifferentialHarness() {
+        testName = "TestDifferentialHarness";
+        DifferentialOptions options;
+        options.threadCount = 2;
+        options.exhaustiveHi = 3000;
+        options.randomSamples = 500;
+        options.edgeValues = false;
+        TrajectoryCache cache(1 << 20);
+        DifferentialMismatch mismatch;
+        uint64_t gamesCompared = 0;
+        const bool matched = RunDifferentialTest(GetDifferentialEngines(&cache), options, &mismatch, &gamesCompared);
+        asserts(3000, matched, gamesCompared, 3491);
+
+        // an engine that gets every game through 451 wrong is caught, and minimized to the game from 451
+        DifferentialEngine broken{ "broken", [](const uint64_t* startValues, size_t count, GameResults* results) {
+            TrajectoryRecorder recorder;
+            for (size_t i = 0; i < count; i++) {
+                results[i] = Play(startValues[i], nullptr, &recorder);
+                for (size_t step = 0; step < recorder.GetStepsCount(); step++) {
+                    if (recorder.GetSteps()[step].GetState() == CalculatorState::FromInt(451)) {
+                        results[i].stepsCount++;
+                    }
+                }
+            }
+        } };
+        options.exhaustiveHi = 20000;
+        const bool brokenMatched = RunDifferentialTest({ broken }, options, &mismatch, &gamesCompared);
+        asserts(9922, !brokenMatched, mismatch.minimizedExpected.startValue, 451);
+        asserts(9922, mismatch.engine == "broken", mismatch.minimizedActual.stepsCount, mismatch.minimizedExpected.stepsCount + 1);
+        asserts(9922, mismatch.expected != mismatch.actual, 0, 0);
+        asserts(451, ReferencePlay(451), mismatch.minimizedExpected);
+    }
+
+    void TestStepCounters() {
+        testName = "TestStepCounters";
+        // 9922 / 22 = 451, 451 / 51 = 8.843137254
+        const StepCounters before = GetStepCounters();
+        Play(9922);
+        const StepCounters& after = GetStepCounters();
+        const uint64_t expected = InstrumentSteps ? 1 : 0;
+        asserts(9922, true, after.intSteps - before.intSteps, 2 * expected);
+        asserts(9922, true, after.fractionSteps - before.fractionSteps, 0);
+        asserts(9922, true, after.repeatingDigitsHits - before.repeatingDigitsHits, expected);
+        asserts(9922, true, after.suffixDivisorDigits[2] - before.suffixDivisorDigits[2], expected);
+
+        // 12.01 takes 2 from its int part: 12.01 * 201
+        const StepCounters beforeFraction = GetStepCounters();
+        NextStep(CalculatorState{ 1201, 2 });
+        asserts(1201, true, after.fractionSteps - beforeFraction.fractionSteps, expected);
+        asserts(1201, true, after.fractionDigits[2] - beforeFraction.fractionDigits[2], expected);
+        asserts(1201, true, after.multiplierExtensionDigits[1] - beforeFraction.multiplierExtensionDigits[1], expected);
+
+        StepCounters merged;
+        merged.Merge(after);
+        merged.Merge(after);
+        asserts(9922, true, merged.intSteps, 2 * after.intSteps);
     }
 
+    // The unit tests of the step functions, cheap enough to run on every launch.
     void RunTests() {
         TestHasTwoRepeatingDigits();
         TestNextStepForInt();
         TestBreakFractionToIntAndFracPart();
         TestNextStepForNonInt();
         TestPlay();
+        TestOverallStats();
+        TestStepCounters();
+    }
+
+    // Runs the startup tests and the ones that are too slow for every launch or use files and sockets.
+    // Returns the number of failures.
+    int RunAllTests() {
+        RunTests();
+        TestSweepStats();
+        TestFindLargestWinners();
+        TestTrajectoryCache();
+        TestPlayBatch();
+        TestDigitTables();
+        TestResultsFile();
+        TestSweepCheckpoint();
+        TestSweepPipeline();
+        TestStratifiedSampling();
+        TestShardedSweep();
+        TestWinnerIndex();
+        TestSummaryIndex();
+        TestSmallValueTable();
+        TestGameRules();
+        TestTrajectoryRecorder();
+        TestDifferentialHarness();
+        TestBenchmarkCompare();
+        TestBackwardSearch();
+        TestQueryEngine();
+        return failures;
     }
 }
 